@@ -3,6 +3,9 @@ struct context;
 struct file;
 struct inode;
 struct pipe;
+struct perfstat;
+struct pollfd;
+struct vdso;
 struct proc;
 struct spinlock;
 struct sleeplock;
@@ -24,18 +27,31 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execproc(struct proc*, char*, char**);
 
 // file.c
 struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
+int             fdremove(int, struct file*);
+struct file*    fdget(int);
 int             fileread(struct file*, uint64, int n);
+int             fileread1(struct file*, int, uint64, int n);
+int             filepoll(struct file*, int);
+int             filepollwait(struct pollfd*, int, int);
+int             filesendfile(struct file*, struct file*, int n);
+int             filesplice(struct file*, struct file*, int n);
 int             filestat(struct file*, uint64 addr);
+int             filetee(struct file*, struct file*, int n);
 int             filewrite(struct file*, uint64, int n);
+int             filewrite1(struct file*, int, uint64, int n);
+void            pollwakeup(void);
+void            polltick(uint);
 
 // fs.c
 void            fsinit(int);
+int             dirents(struct inode*, uint*, uint64, int);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
@@ -48,6 +64,7 @@ void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
+struct inode*   nameiat(struct inode*, char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
@@ -61,6 +78,10 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_zeroed(void);
+int             kzeroidle(void);
+void*           ksuperalloc(void);
+void            ksuperfree(void *);
 void            kfree(void *);
 void            kinit(void);
 
@@ -73,18 +94,36 @@ void            end_op(void);
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             pipedrain(struct pipe*, struct file*, int);
+int             pipefill(struct pipe*, struct file*, int);
+int             pipepoll(struct pipe*, int);
+int             piperead(struct pipe*, uint64, int, int);
+int             pipesplice(struct pipe*, struct pipe*, int, int);
+int             pipewrite(struct pipe*, uint64, int, int);
 
 // printf.c
 void            printf(char*, ...);
 void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
 
+// prof.c
+extern int      profiling;
+void            profinit(void);
+void            profkernel(uint64, uint64);
+void            profuser(struct proc*);
+int             profctl(int);
+int             profread(uint64, int);
+
 // proc.c
 int             cpuid(void);
+int             procsyscalls(int, uint64*);
+void            procperf(struct perfstat*);
 void            exit(int);
 int             fork(void);
+int             vfork(void);
+int             spawn(char*, char**, struct file**);
+int             clone(uint64, uint64, uint64);
+void            vforkdone(struct proc*);
 int             growproc(int);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
@@ -101,6 +140,8 @@ void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
 void            yield(void);
+void            asidflush(struct proc*);
+int             vmsync(struct proc*);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -138,13 +179,24 @@ int             argaddr(int, uint64 *);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
+int             sysstatcopy(int, uint64);
+
+// trace.c
+extern uint     tracemask;
+void            traceinit(void);
+void            tracerecord(int, uint64, uint64);
+int             tracectl(uint);
+int             traceread(uint64, int);
 
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
+void            usertrap(void);
 void            usertrapret(void);
+void            usertrapsetup(struct proc*);
+extern struct vdso *vdso;
 
 // uart.c
 void            uartinit(void);
@@ -153,12 +205,16 @@ void            uartputc(int);
 void            uartputc_sync(int);
 int             uartgetc(void);
 
+// uring.c
+int             uringenter(uint64, int);
+
 // vm.c
 void            kvminit(void);
 void            kvminithart(void);
 uint64          kvmpa(uint64);
 void            kvmmap(uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
+int             mapsuper(pagetable_t, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
@@ -166,11 +222,23 @@ uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
-void            uvmclear(pagetable_t, uint64);
+int             uvmclear(pagetable_t, uint64);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
+pagetable_t     kvmcreate(void);
+void            kvmfree(pagetable_t);
+int             kvmcopy(pagetable_t, pagetable_t, uint64, uint64);
+void            kvmdealloc(pagetable_t, uint64, uint64);
+void            kvmshare(pagetable_t, pagetable_t);
+void            kvmunmirror(pagetable_t, int);
+
+// vmcopyin.c
+int             uvmdirect(pagetable_t, uint64, uint64);
+int             copyin_new(pagetable_t, char *, uint64, uint64);
+int             copyout_new(pagetable_t, uint64, char *, uint64);
+int             copyinstr_new(pagetable_t, char *, uint64, uint64);
 
 // plic.c
 void            plicinit(void);
@@ -185,3 +253,7 @@ void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+
+// record a trace event if tracepoint ev is enabled.
+#define TRACE(ev, a0, a1) \
+  do { if(tracemask & (1 << (ev))) tracerecord((ev), (a0), (a1)); } while(0)
@@ -11,6 +11,15 @@ static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uin
 
 int
 exec(char *path, char **argv)
+{
+  return execproc(myproc(), path, argv);
+}
+
+// Replace the user memory of p with the program in path.
+// p is the caller, or a process spawn() is making that has
+// not run yet.
+int
+execproc(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
@@ -19,7 +28,10 @@ exec(char *path, char **argv)
   struct inode *ip;
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
+
+  // other threads would lose their memory with p's.
+  if(p->sh->ref > 1)
+    return -1;
 
   begin_op();
 
@@ -61,7 +73,6 @@ exec(char *path, char **argv)
   end_op();
   ip = 0;
 
-  p = myproc();
   uint64 oldsz = p->sz;
 
   // Allocate two pages at the next page boundary.
@@ -71,7 +82,8 @@ exec(char *path, char **argv)
   if((sz1 = uvmalloc(pagetable, sz, sz + 2*PGSIZE)) == 0)
     goto bad;
   sz = sz1;
-  uvmclear(pagetable, sz-2*PGSIZE);
+  if(uvmclear(pagetable, sz-2*PGSIZE) < 0)
+    goto bad;
   sp = sz;
   stackbase = sp - PGSIZE;
 
@@ -107,6 +119,29 @@ exec(char *path, char **argv)
     if(*s == '/')
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
+
+  // Mirror the new image in the kernel page table; nothing
+  // from here on reads the old image through it. If that
+  // fails, put the old mirror back, which needs no new
+  // page-table pages. A vfork() child's mirror is its
+  // parent's page-table pages, so it is dropped, not
+  // cleared, and shared again on failure.
+  if(p->vfork)
+    kvmunmirror(p->kpagetable, 0);
+  else
+    kvmdealloc(p->kpagetable, oldsz, 0);
+  if(kvmcopy(pagetable, p->kpagetable, 0, sz) < 0){
+    if(p->vfork){
+      kvmunmirror(p->kpagetable, 1);
+      kvmshare(p->parent->kpagetable, p->kpagetable);
+    } else {
+      kvmdealloc(p->kpagetable, sz, 0);
+      kvmcopy(p->pagetable, p->kpagetable, 0, oldsz);
+    }
+    asidflush(p);
+    goto bad;
+  }
+  asidflush(p);
     
   // Commit to the user image.
   oldpagetable = p->pagetable;
@@ -114,7 +149,14 @@ exec(char *path, char **argv)
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
-  proc_freepagetable(oldpagetable, oldsz);
+  if(p->vfork){
+    // the old user memory was the parent's.
+    oldpagetable[0] = 0;
+    proc_freepagetable(oldpagetable, 0);
+    vforkdone(p);
+  } else {
+    proc_freepagetable(oldpagetable, oldsz);
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -3,3 +3,11 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+#define O_NONBLOCK 0x800
+
+// fstatat() directory meaning the current directory
+#define AT_FDCWD  -100
+
+// fcntl() commands
+#define F_GETFL   1
+#define F_SETFL   2
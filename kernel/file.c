@@ -12,6 +12,7 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "poll.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -19,10 +20,22 @@ struct {
   struct file file[NFILE];
 } ftable;
 
+// Processes in poll() sleep here. Anything that can make a
+// file readable or writable calls pollwakeup(), which only
+// takes the lock when some process is actually polling.
+struct {
+  struct spinlock lock;
+  int nwait;  // processes in poll()
+  uint seq;   // bumped by each pollwakeup()
+  int timed;      // some process in poll() has a timeout,
+  uint deadline;  // the earliest of which ends at this tick
+} pollq;
+
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  initlock(&pollq.lock, "pollq");
 }
 
 // Allocate a file structure.
@@ -43,6 +56,43 @@ filealloc(void)
   return 0;
 }
 
+// The caller's open file fd, with a reference of its own
+// for the caller to fileclose() when done, so that another
+// thread closing fd meanwhile cannot free it. Returns 0 if
+// fd is not open.
+struct file*
+fdget(int fd)
+{
+  struct share *sh = myproc()->sh;
+  struct file *f = 0;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  acquire(&sh->lock);
+  if(sh->ofile[fd])
+    f = filedup(sh->ofile[fd]);
+  release(&sh->lock);
+  return f;
+}
+
+// Take f out of the caller's descriptor fd, for the caller
+// to fileclose(), unless another thread sharing the
+// descriptors has already done so. Returns 0, or -1.
+int
+fdremove(int fd, struct file *f)
+{
+  struct share *sh = myproc()->sh;
+  int r = -1;
+
+  acquire(&sh->lock);
+  if(sh->ofile[fd] == f){
+    sh->ofile[fd] = 0;
+    r = 0;
+  }
+  release(&sh->lock);
+  return r;
+}
+
 // Increment ref count for file f.
 struct file*
 filedup(struct file *f)
@@ -101,50 +151,57 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
-// Read from file f.
-// addr is a user virtual address.
+// Read from an inode or device file.
+// addr is a user virtual address if user_dst is set,
+// otherwise a kernel address.
 int
-fileread(struct file *f, uint64 addr, int n)
+fileread1(struct file *f, int user_dst, uint64 addr, int n)
 {
   int r = 0;
 
-  if(f->readable == 0)
-    return -1;
-
-  if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
+  if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
-    r = devsw[f->major].read(1, addr, n);
+    r = devsw[f->major].read(user_dst, addr, n);
   } else if(f->type == FD_INODE){
     ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+    if((r = readi(f->ip, user_dst, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
   } else {
-    panic("fileread");
+    panic("fileread1");
   }
 
   return r;
 }
 
-// Write to file f.
+// Read from file f.
 // addr is a user virtual address.
 int
-filewrite(struct file *f, uint64 addr, int n)
+fileread(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
+  if(f->readable == 0)
+    return -1;
 
-  if(f->writable == 0)
+  if(f->type == FD_PIPE)
+    return piperead(f->pipe, addr, n, f->nonblock);
+  if(f->nonblock && (filepoll(f, POLLIN) & POLLIN) == 0)
     return -1;
+  return fileread1(f, 1, addr, n);
+}
 
-  if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
+// Write to an inode or device file.
+// addr is a user virtual address if user_src is set,
+// otherwise a kernel address.
+int
+filewrite1(struct file *f, int user_src, uint64 addr, int n)
+{
+  int r, ret = 0;
+
+  if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
-    ret = devsw[f->major].write(1, addr, n);
+    ret = devsw[f->major].write(user_src, addr, n);
   } else if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
     // the maximum log transaction size, including
@@ -161,7 +218,7 @@ filewrite(struct file *f, uint64 addr, int n)
 
       begin_op();
       ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
+      if ((r = writei(f->ip, user_src, addr + i, f->off, n1)) > 0)
         f->off += r;
       iunlock(f->ip);
       end_op();
@@ -174,9 +231,213 @@ filewrite(struct file *f, uint64 addr, int n)
     }
     ret = (i == n ? n : -1);
   } else {
-    panic("filewrite");
+    panic("filewrite1");
   }
 
   return ret;
 }
 
+// Write to file f.
+// addr is a user virtual address.
+int
+filewrite(struct file *f, uint64 addr, int n)
+{
+  if(f->writable == 0)
+    return -1;
+
+  if(f->type == FD_PIPE)
+    return pipewrite(f->pipe, addr, n, f->nonblock);
+  return filewrite1(f, 1, addr, n);
+}
+
+// Move up to n bytes from file in to file out without
+// copying through user memory. At least one of them
+// must be a pipe.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+
+  if(in->type == FD_PIPE && out->type == FD_PIPE)
+    return pipesplice(in->pipe, out->pipe, n, 1);
+  if(out->type == FD_PIPE)
+    return pipefill(out->pipe, in, n);
+  if(in->type == FD_PIPE)
+    return pipedrain(in->pipe, out, n);
+  return -1;
+}
+
+// Copy up to n bytes from pipe in to pipe out,
+// leaving them in in as well.
+int
+filetee(struct file *in, struct file *out, int n)
+{
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(in->type != FD_PIPE || out->type != FD_PIPE)
+    return -1;
+  return pipesplice(in->pipe, out->pipe, n, 0);
+}
+
+// Copy up to n bytes from the offset of inode file in
+// to file out, through a kernel page rather than user memory.
+int
+filesendfile(struct file *out, struct file *in, int n)
+{
+  int i, m, r, w;
+  char *buf;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(in->type != FD_INODE)
+    return -1;
+  if(out->type == FD_PIPE)
+    return pipefill(out->pipe, in, n);
+
+  if((buf = kalloc()) == 0)
+    return -1;
+  for(i = 0; i < n; i += w){
+    m = n - i;
+    if(m > PGSIZE)
+      m = PGSIZE;
+    if((r = fileread1(in, 0, (uint64)buf, m)) <= 0){
+      if(r < 0 && i == 0)
+        i = -1;
+      break;
+    }
+    if((w = filewrite1(out, 0, (uint64)buf, r)) != r){
+      if(w > 0)
+        i += w;
+      else if(i == 0)
+        i = -1;
+      break;
+    }
+  }
+  kfree(buf);
+  return i;
+}
+
+// Return the subset of events (plus POLLERR and POLLHUP)
+// that currently hold for file f.
+int
+filepoll(struct file *f, int events)
+{
+  int r;
+
+  if(f->type == FD_PIPE)
+    r = pipepoll(f->pipe, f->writable);
+  else if(f->type == FD_DEVICE && f->major >= 0 && f->major < NDEV &&
+          devsw[f->major].poll)
+    r = devsw[f->major].poll();
+  else
+    r = POLLIN | POLLOUT;
+
+  if(f->readable == 0)
+    r &= ~POLLIN;
+  if(f->writable == 0)
+    r &= ~POLLOUT;
+  return r & (events | POLLERR | POLLHUP);
+}
+
+// Fill in revents for each of fds[0..nfds-1]. Returns the
+// number of entries with nonzero revents.
+static int
+pollscan(struct pollfd *fds, int nfds)
+{
+  struct file *f;
+  int i, n = 0;
+
+  for(i = 0; i < nfds; i++){
+    fds[i].revents = 0;
+    if(fds[i].fd < 0)
+      continue;
+    if((f = fdget(fds[i].fd)) == 0){
+      fds[i].revents = POLLNVAL;
+    } else {
+      fds[i].revents = filepoll(f, fds[i].events);
+      fileclose(f);
+    }
+    if(fds[i].revents)
+      n++;
+  }
+  return n;
+}
+
+// Wait until at least one of fds is ready or timeout ticks
+// have passed; a negative timeout waits forever.
+// Returns the number of ready entries, or -1 if killed.
+int
+filepollwait(struct pollfd *fds, int nfds, int timeout)
+{
+  struct proc *p = myproc();
+  uint start, seq;
+  int n;
+
+  acquire(&tickslock);
+  start = ticks;
+  release(&tickslock);
+
+  acquire(&pollq.lock);
+  pollq.nwait++;
+  __sync_synchronize();
+  for(;;){
+    // the scan takes pipe and console locks, so drop
+    // pollq.lock; seq tells whether a wakeup landed
+    // while it was not held.
+    seq = pollq.seq;
+    release(&pollq.lock);
+    n = pollscan(fds, nfds);
+    acquire(&pollq.lock);
+    if(n > 0 || timeout == 0)
+      break;
+    if(p->killed){
+      n = -1;
+      break;
+    }
+    if(timeout > 0 && ticks - start >= timeout)
+      break;
+    if(timeout > 0){
+      // have polltick() wake us when the time is up.
+      if(!pollq.timed || (int)(start + timeout - pollq.deadline) < 0)
+        pollq.deadline = start + timeout;
+      pollq.timed = 1;
+    }
+    if(pollq.seq == seq)
+      sleep(&pollq, &pollq.lock);
+  }
+  pollq.nwait--;
+  release(&pollq.lock);
+  return n;
+}
+
+// Wake processes in poll(); called without other locks held.
+void
+pollwakeup(void)
+{
+  __sync_synchronize();
+  if(pollq.nwait == 0)
+    return;
+  acquire(&pollq.lock);
+  pollq.seq++;
+  wakeup(&pollq);
+  release(&pollq.lock);
+}
+
+// Called by clockintr() each tick: wake processes in poll()
+// once the earliest timeout has run out. Those still
+// waiting set the next deadline before sleeping again.
+void
+polltick(uint now)
+{
+  __sync_synchronize();
+  if(!pollq.timed || (int)(now - pollq.deadline) < 0)
+    return;
+  acquire(&pollq.lock);
+  if(pollq.timed && (int)(now - pollq.deadline) >= 0){
+    pollq.timed = 0;
+    pollq.seq++;
+    wakeup(&pollq);
+  }
+  release(&pollq.lock);
+}
@@ -579,6 +579,72 @@ dirlink(struct inode *dp, char *name, uint inum)
   return 0;
 }
 
+// Number of entries dirents() reads per locking of the directory.
+#define DENTBATCH 8
+
+// Read up to n entries of directory dp, starting at byte
+// offset *off, into the user array dst of struct dent.
+// Empty slots are skipped. Advances *off past the entries
+// copied out and returns how many there were. If dst stops
+// being writable partway, returns the entries copied before
+// that, or -1 if none; the first entry not copied out is
+// read again next time.
+// Must be called inside a transaction since it calls iput(),
+// and without dp locked.
+int
+dirents(struct inode *dp, uint *off, uint64 dst, int n)
+{
+  struct dirent de[DENTBATCH];
+  struct inode *ip[DENTBATCH];
+  uint at[DENTBATCH];   // offset of each entry in dp
+  struct dent d;
+  int i, m, got, bad;
+
+  got = 0;
+  bad = -1;   // first entry of the batch not copied out
+  while(got < n && bad < 0){
+    ilock(dp);
+    if(dp->type != T_DIR){
+      iunlock(dp);
+      return -1;
+    }
+    // Take references while dp is locked, so that an entry's
+    // inode cannot be freed before it is looked at.
+    m = 0;
+    while(m < DENTBATCH && got + m < n && *off + sizeof(de[0]) <= dp->size){
+      if(readi(dp, 0, (uint64)&de[m], *off, sizeof(de[0])) != sizeof(de[0]))
+        panic("dirents read");
+      at[m] = *off;
+      *off += sizeof(de[0]);
+      if(de[m].inum == 0)
+        continue;
+      ip[m] = iget(dp->dev, de[m].inum);
+      m++;
+    }
+    iunlock(dp);
+    if(m == 0)
+      break;
+
+    for(i = 0; i < m; i++){
+      ilock(ip[i]);
+      d.size = ip[i]->size;
+      d.inum = ip[i]->inum;
+      d.type = ip[i]->type;
+      iunlockput(ip[i]);
+      memset(d.name, 0, sizeof(d.name));
+      memmove(d.name, de[i].name, DIRSIZ);
+      if(bad < 0 && either_copyout(1, dst + (got+i)*sizeof(d), &d, sizeof(d)) < 0){
+        *off = at[i];
+        bad = i;
+      }
+    }
+    got += bad < 0 ? m : bad;
+  }
+  if(bad >= 0 && got == 0)
+    return -1;
+  return got;
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -618,19 +684,37 @@ skipelem(char *path, char *name)
   return path;
 }
 
+// The caller's current directory, with a reference of its
+// own: another thread's chdir() may put the old one.
+static struct inode*
+idupcwd(void)
+{
+  struct share *sh = myproc()->sh;
+  struct inode *ip;
+
+  acquire(&sh->lock);
+  ip = idup(sh->cwd);
+  release(&sh->lock);
+  return ip;
+}
+
 // Look up and return the inode for a path name.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
+// A relative path starts at dp, or at the current directory
+// if dp is 0.
 // Must be called inside a transaction since it calls iput().
 static struct inode*
-namex(char *path, int nameiparent, char *name)
+namex(struct inode *dp, char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
+  else if(dp)
+    ip = idup(dp);
   else
-    ip = idup(myproc()->cwd);
+    ip = idupcwd();
 
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
@@ -661,11 +745,19 @@ struct inode*
 namei(char *path)
 {
   char name[DIRSIZ];
-  return namex(path, 0, name);
+  return namex(0, path, 0, name);
+}
+
+// Like namei(), but a relative path starts at directory dp.
+struct inode*
+nameiat(struct inode *dp, char *path)
+{
+  char name[DIRSIZ];
+  return namex(dp, path, 0, name);
 }
 
 struct inode*
 nameiparent(char *path, char *name)
 {
-  return namex(path, 1, name);
+  return namex(0, path, 1, name);
 }
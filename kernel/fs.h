@@ -58,3 +58,12 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// A directory entry as returned by getdents(), with the
+// type and size of the inode it names.
+struct dent {
+  uint size;
+  ushort inum;
+  short type;
+  char name[DIRSIZ+2];   // always null-terminated
+};
+
@@ -1,6 +1,7 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// and 2MB megapages for large user allocations.
 
 #include "types.h"
 #include "param.h"
@@ -10,6 +11,7 @@
 #include "defs.h"
 
 void freerange(void *pa_start, void *pa_end);
+static int ksplit(void);
 
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
@@ -18,16 +20,35 @@ struct run {
   struct run *next;
 };
 
+// Free pages are kept on two lists: freelist, whose contents
+// are garbage, and zerolist, which idle CPUs fill with pages
+// they have cleared (see kzeroidle()), so that kalloc_zeroed()
+// rarely has to clear a page itself.
 struct {
   struct spinlock lock;
   struct run *freelist;
+  struct run *zerolist;
+  struct run *superlist;  // free megapages
 } kmem;
 
+#define KZEROBATCH 8  // pages cleared per kzeroidle() call
+
 void
 kinit()
 {
+  char *p, *super;
+
   initlock(&kmem.lock, "kmem");
-  freerange(end, (void*)PHYSTOP);
+
+  // set aside the top NSUPERPG megapages of RAM
+  // for ksuperalloc(); kalloc() breaks them up
+  // into pages when it runs out.
+  super = (char*)(PHYSTOP - NSUPERPG*SUPERPGSIZE);
+  if(super < end)
+    super = (char*)SUPERPGROUNDUP((uint64)end);
+  freerange(end, super);
+  for(p = super; p + SUPERPGSIZE <= (char*)PHYSTOP; p += SUPERPGSIZE)
+    ksuperfree(p);
 }
 
 void
@@ -51,8 +72,10 @@ kfree(void *pa)
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+#ifdef KDEBUG
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
 
   r = (struct run*)pa;
 
@@ -71,12 +94,124 @@ kalloc(void)
   struct run *r;
 
   acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
+  if(kmem.freelist == 0 && kmem.zerolist == 0)
+    ksplit();
+  if((r = kmem.freelist) != 0)
     kmem.freelist = r->next;
+  else if((r = kmem.zerolist) != 0)
+    kmem.zerolist = r->next;
   release(&kmem.lock);
 
+#ifdef KDEBUG
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
+  return (void*)r;
+}
+
+// Allocate one 4096-byte page of physical memory,
+// filled with zeros.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_zeroed(void)
+{
+  struct run *r;
+  int zeroed = 1;
+
+  acquire(&kmem.lock);
+  if(kmem.freelist == 0 && kmem.zerolist == 0)
+    ksplit();
+  if((r = kmem.zerolist) != 0)
+    kmem.zerolist = r->next;
+  else if((r = kmem.freelist) != 0){
+    kmem.freelist = r->next;
+    zeroed = 0;
+  }
+  release(&kmem.lock);
+
+  if(r == 0)
+    return 0;
+  if(zeroed)
+    r->next = 0;  // the list link is the only nonzero word
+  else
+    memset((char*)r, 0, PGSIZE);
+  return (void*)r;
+}
+
+// Called by an idle CPU's scheduler: clear a few pages from
+// the free list and move them to the zeroed list.
+// Returns 0 if there was nothing to clear.
+int
+kzeroidle(void)
+{
+  struct run *r;
+  int n;
+
+  for(n = 0; n < KZEROBATCH; n++){
+    acquire(&kmem.lock);
+    if((r = kmem.freelist) != 0)
+      kmem.freelist = r->next;
+    release(&kmem.lock);
+    if(r == 0)
+      break;
+
+    memset((char*)r, 0, PGSIZE);
+
+    acquire(&kmem.lock);
+    r->next = kmem.zerolist;
+    kmem.zerolist = r;
+    release(&kmem.lock);
+  }
+  return n;
+}
+
+// Break a free megapage up into pages on the free list.
+// Returns 0 if there was none. kmem.lock must be held.
+static int
+ksplit(void)
+{
+  struct run *r;
+  char *p;
+
+  if((r = kmem.superlist) == 0)
+    return 0;
+  kmem.superlist = r->next;
+  for(p = (char*)r; p < (char*)r + SUPERPGSIZE; p += PGSIZE){
+    ((struct run*)p)->next = kmem.freelist;
+    kmem.freelist = (struct run*)p;
+  }
+  return 1;
+}
+
+// Free a megapage returned by ksuperalloc().
+void
+ksuperfree(void *pa)
+{
+  struct run *r;
+
+  if(((uint64)pa % SUPERPGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("ksuperfree");
+
+  r = (struct run*)pa;
+
+  acquire(&kmem.lock);
+  r->next = kmem.superlist;
+  kmem.superlist = r;
+  release(&kmem.lock);
+}
+
+// Allocate one 2MB megapage, aligned to its size.
+// Its contents are garbage.
+// Returns 0 if there is none free.
+void *
+ksuperalloc(void)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  r = kmem.superlist;
+  if(r)
+    kmem.superlist = r->next;
+  release(&kmem.lock);
   return (void*)r;
 }
@@ -27,6 +27,8 @@ main()
     binit();         // buffer cache
     iinit();         // inode cache
     fileinit();      // file table
+    profinit();      // sampling profiler
+    traceinit();     // tracepoints
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -29,6 +29,8 @@
 #define CLINT 0x2000000L
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define TIMEBASE 10000000   // CLINT_MTIME and time CSR rate, in Hz.
+#define TICKCYCLES 1000000  // cycles per timer interrupt; 1/10th second.
 
 // qemu puts programmable interrupt controller here.
 #define PLIC 0x0c000000L
@@ -51,9 +53,11 @@
 // in both user and kernel space.
 #define TRAMPOLINE (MAXVA - PGSIZE)
 
-// map kernel stacks beneath the trampoline,
-// each surrounded by invalid guard pages.
-#define KSTACK(p) (TRAMPOLINE - ((p)+1)* 2*PGSIZE)
+// map kernel stacks beneath the pages that user page tables
+// have under the trampoline (see below), each surrounded by
+// invalid guard pages. kernel mappings are global, so no
+// kernel address but the trampoline's may be a user one.
+#define KSTACK(p) (VDSOPROC - ((p)+1)* 2*PGSIZE)
 
 // User memory layout.
 // Address zero first:
@@ -62,6 +66,10 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   VDSOPROC (p->vdso, read-only per-process data)
+//   VDSO (read-only data shared by all processes)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define VDSO (TRAPFRAME - PGSIZE)
+#define VDSOPROC (VDSO - PGSIZE)
@@ -0,0 +1,13 @@
+//
+// Per-process hardware counts, returned by perfstat().
+// The cycle and instret CSRs count for the whole CPU, so
+// the scheduler charges each process for the counts that
+// accrue while it is switched in, in user and kernel mode.
+//
+
+struct perfstat {
+  uint64 cycles;    // cycles run by this process
+  uint64 instret;   // instructions it retired
+  uint64 ccycles;   // the same, summed over waited-for children
+  uint64 cinstret;
+};
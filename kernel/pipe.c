@@ -7,22 +7,47 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
 
-#define PIPESIZE 512
+// the pipe buffer is a ring of whole pages, so that
+// data moves in page-sized runs rather than byte by byte,
+// and so that splice() can hand whole pages between pipes.
+#define PIPEPAGES 4
+#define PIPESIZE (PIPEPAGES*PGSIZE)
 
+// a reader or writer claims its side of the pipe (rbusy,
+// wbusy) for the duration of a transfer, so that it can
+// copy to or from the buffer pages without holding
+// pi->lock, e.g. while readi() or writei() sleep.
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *data[PIPEPAGES]; // ring of buffer pages
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rbusy;      // a reader owns the read side
+  int wbusy;      // a writer owns the write side
+  int nrwait;     // processes sleeping on nread
+  int nwwait;     // processes sleeping on nwrite
 };
 
+static void
+pipefree(struct pipe *pi)
+{
+  int i;
+
+  for(i = 0; i < PIPEPAGES; i++)
+    if(pi->data[i])
+      kfree(pi->data[i]);
+  kfree((char*)pi);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
   struct pipe *pi;
+  int i;
 
   pi = 0;
   *f0 = *f1 = 0;
@@ -30,6 +55,10 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((pi = (struct pipe*)kalloc()) == 0)
     goto bad;
+  memset(pi, 0, sizeof(*pi));
+  for(i = 0; i < PIPEPAGES; i++)
+    if((pi->data[i] = kalloc()) == 0)
+      goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
@@ -38,16 +67,18 @@ pipealloc(struct file **f0, struct file **f1)
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
   (*f0)->writable = 0;
+  (*f0)->nonblock = 0;
   (*f0)->pipe = pi;
   (*f1)->type = FD_PIPE;
   (*f1)->readable = 0;
   (*f1)->writable = 1;
+  (*f1)->nonblock = 0;
   (*f1)->pipe = pi;
   return 0;
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    pipefree(pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,60 +99,360 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
-  } else
+    pipefree(pi);
+  } else {
     release(&pi->lock);
+    pollwakeup();
+  }
 }
 
+// Report which of POLLIN, POLLOUT, POLLHUP and POLLERR
+// apply to the read end (writable == 0) or the write end of pi.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipepoll(struct pipe *pi, int writable)
+{
+  int r = 0;
+
+  acquire(&pi->lock);
+  if(writable){
+    if(pi->readopen == 0)
+      r |= POLLERR;
+    else if(pi->nwrite != pi->nread + PIPESIZE)
+      r |= POLLOUT;
+  } else {
+    if(pi->nread != pi->nwrite)
+      r |= POLLIN;
+    if(pi->writeopen == 0)
+      r |= POLLIN | POLLHUP;
+  }
+  release(&pi->lock);
+  return r;
+}
+
+// length of the run that starts at ring offset off, holds at
+// most avail bytes, at most n bytes, and stays within one
+// buffer page, so that it can be moved with a single copy.
+static int
+pipespan(uint off, uint avail, int n)
+{
+  uint m;
+
+  m = PGSIZE - off % PGSIZE;
+  if(m > avail)
+    m = avail;
+  if(m > n)
+    m = n;
+  return m;
+}
+
+// Wait for the read side of pi to be free and for data
+// to arrive, then claim the read side.
+// Returns 1 if claimed, 0 at end of file,
+// -1 if the process has been killed or if it
+// would have to wait and nonblock is set.
+static int
+piperclaim(struct pipe *pi, int nonblock)
 {
-  int i;
-  char ch;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
-  for(i = 0; i < n; i++){
-    while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
-      if(pi->readopen == 0 || pr->killed){
-        release(&pi->lock);
-        return -1;
-      }
-      wakeup(&pi->nread);
-      sleep(&pi->nwrite, &pi->lock);
+  while(pi->rbusy || (pi->nread == pi->nwrite && pi->writeopen)){  //DOC: pipe-empty
+    if(nonblock || pr->killed){
+      release(&pi->lock);
+      return -1;
     }
-    if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-      break;
-    pi->data[pi->nwrite++ % PIPESIZE] = ch;
+    pi->nrwait++;
+    sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+    pi->nrwait--;
+  }
+  if(pi->nread == pi->nwrite){
+    release(&pi->lock);
+    return 0;
   }
-  wakeup(&pi->nread);
+  pi->rbusy = 1;
   release(&pi->lock);
-  return i;
+  return 1;
 }
 
-int
-piperead(struct pipe *pi, uint64 addr, int n)
+static void
+piperunclaim(struct pipe *pi)
+{
+  acquire(&pi->lock);
+  pi->rbusy = 0;
+  if(pi->nrwait)
+    wakeup(&pi->nread);
+  release(&pi->lock);
+}
+
+// Wait for the write side of pi to be free, then claim it.
+// Returns 0 if claimed, -1 if the read side is closed,
+// the process has been killed, or it would have to wait
+// and nonblock is set.
+static int
+pipewclaim(struct pipe *pi, int nonblock)
 {
-  int i;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
-    if(pr->killed){
+  while(pi->wbusy){
+    if(nonblock || pi->readopen == 0 || pr->killed){
       release(&pi->lock);
       return -1;
     }
-    sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+    pi->nwwait++;
+    sleep(&pi->nwrite, &pi->lock);
+    pi->nwwait--;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
+  if(pi->readopen == 0 || pr->killed){
+    release(&pi->lock);
+    return -1;
+  }
+  pi->wbusy = 1;
+  release(&pi->lock);
+  return 0;
+}
+
+static void
+pipewunclaim(struct pipe *pi)
+{
+  acquire(&pi->lock);
+  pi->wbusy = 0;
+  if(pi->nwwait)
+    wakeup(&pi->nwrite);
+  release(&pi->lock);
+}
+
+// Return the length of the buffered run that starts skip
+// bytes past the read position, at most n, and set *src
+// to its first byte. Returns 0 if nothing is buffered there.
+// The caller must own the read side.
+static int
+pipepeek(struct pipe *pi, uint skip, int n, char **src)
+{
+  uint avail, off;
+  int m;
+
+  acquire(&pi->lock);
+  avail = pi->nwrite - pi->nread;
+  if(avail <= skip){
+    release(&pi->lock);
+    return 0;
+  }
+  off = (pi->nread + skip) % PIPESIZE;
+  m = pipespan(off, avail - skip, n);
+  *src = pi->data[off/PGSIZE] + off%PGSIZE;
+  release(&pi->lock);
+  return m;
+}
+
+// Mark m bytes at the read position as consumed.
+static void
+pipeconsume(struct pipe *pi, int m)
+{
+  acquire(&pi->lock);
+  pi->nread += m;
+  if(pi->nwwait)
+    wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  release(&pi->lock);
+  pollwakeup();
+}
+
+// Wait for free space in pi, then return the length of the
+// free run at the write position, at most n, and set *dst
+// to its first byte. Returns -1 if the read side is closed
+// or the process has been killed, and 0 if pi is full and
+// nonblock is set. The caller must own the write side.
+static int
+piperoom(struct pipe *pi, int n, char **dst, int nonblock)
+{
+  struct proc *pr = myproc();
+  uint off;
+  int m;
+
+  acquire(&pi->lock);
+  while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
+    if(pi->readopen == 0 || pr->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    if(nonblock){
+      release(&pi->lock);
+      return 0;
+    }
+    if(pi->nrwait)
+      wakeup(&pi->nread);
+    pi->nwwait++;
+    sleep(&pi->nwrite, &pi->lock);
+    pi->nwwait--;
+  }
+  off = pi->nwrite % PIPESIZE;
+  m = pipespan(off, pi->nread + PIPESIZE - pi->nwrite, n);
+  *dst = pi->data[off/PGSIZE] + off%PGSIZE;
+  release(&pi->lock);
+  return m;
+}
+
+// Make m bytes at the write position visible to readers.
+static void
+pipepublish(struct pipe *pi, int m)
+{
+  acquire(&pi->lock);
+  pi->nwrite += m;
+  if(pi->nrwait)
+    wakeup(&pi->nread);
+  release(&pi->lock);
+  pollwakeup();
+}
+
+int
+pipewrite(struct pipe *pi, uint64 addr, int n, int nonblock)
+{
+  int i, m;
+  char *dst;
+  struct proc *pr = myproc();
+
+  if(pipewclaim(pi, nonblock) < 0)
+    return -1;
+  for(i = 0; i < n; i += m){
+    if((m = piperoom(pi, n - i, &dst, nonblock)) <= 0){
+      if(m < 0 || i == 0)
+        i = -1;
       break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+    }
+    if(copyin(pr->pagetable, dst, addr + i, m) == -1)
       break;
+    pipepublish(pi, m);
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
-  release(&pi->lock);
+  pipewunclaim(pi);
+  return i;
+}
+
+int
+piperead(struct pipe *pi, uint64 addr, int n, int nonblock)
+{
+  int i, m, r;
+  char *src;
+  struct proc *pr = myproc();
+
+  if((r = piperclaim(pi, nonblock)) <= 0)
+    return r;
+  for(i = 0; i < n; i += m){  //DOC: piperead-copy
+    if((m = pipepeek(pi, 0, n - i, &src)) == 0)
+      break;
+    if(copyout(pr->pagetable, addr + i, src, m) == -1)
+      break;
+    pipeconsume(pi, m);
+  }
+  piperunclaim(pi);
+  return i;
+}
+
+// Move up to n bytes from pipe in to pipe out. A full,
+// page-aligned buffer page is handed over to out instead
+// of being copied. If consume is 0 the bytes stay in in,
+// which is how tee() duplicates a pipe.
+// Returns the number of bytes moved, 0 at end of file,
+// or -1 on error.
+int
+pipesplice(struct pipe *in, struct pipe *out, int n, int consume)
+{
+  int i, m, r;
+  char *src, *dst, *pg;
+  uint ri, wi;
+
+  if(in == out)
+    return -1;
+  if((r = piperclaim(in, 0)) <= 0)
+    return r;
+  if(pipewclaim(out, 0) < 0){
+    piperunclaim(in);
+    return -1;
+  }
+  for(i = 0; i < n; i += m){
+    if((m = pipepeek(in, consume ? 0 : i, n - i, &src)) == 0)
+      break;
+    if((m = piperoom(out, m, &dst, 0)) < 0){
+      if(i == 0)
+        i = -1;
+      break;
+    }
+    if(consume && m == PGSIZE){
+      // both runs are whole pages: swap the full page of
+      // in with the free page of out. we own both sides,
+      // so no one else looks at either slot meanwhile.
+      ri = (in->nread % PIPESIZE) / PGSIZE;
+      wi = (out->nwrite % PIPESIZE) / PGSIZE;
+      pg = in->data[ri];
+      in->data[ri] = out->data[wi];
+      out->data[wi] = pg;
+    } else {
+      memmove(dst, src, m);
+    }
+    if(consume)
+      pipeconsume(in, m);
+    pipepublish(out, m);
+  }
+  pipewunclaim(out);
+  piperunclaim(in);
+  return i;
+}
+
+// Move up to n bytes from file f (an inode or device)
+// into pi, reading straight into the pipe's buffer pages.
+// Returns the number of bytes moved, or -1 on error.
+int
+pipefill(struct pipe *pi, struct file *f, int n)
+{
+  int i, m, r;
+  char *dst;
+
+  if(pipewclaim(pi, 0) < 0)
+    return -1;
+  i = 0;
+  while(i < n){
+    if((m = piperoom(pi, n - i, &dst, 0)) < 0){
+      if(i == 0)
+        i = -1;
+      break;
+    }
+    if((r = fileread1(f, 0, (uint64)dst, m)) <= 0){
+      if(r < 0 && i == 0)
+        i = -1;
+      break;
+    }
+    pipepublish(pi, r);
+    i += r;
+    if(r < m)
+      break;  // end of file, or a short console line.
+  }
+  pipewunclaim(pi);
+  return i;
+}
+
+// Move up to n bytes from pi to file f (an inode or device),
+// writing straight from the pipe's buffer pages.
+// Returns the number of bytes moved, 0 at end of file,
+// or -1 on error.
+int
+pipedrain(struct pipe *pi, struct file *f, int n)
+{
+  int i, m, r;
+  char *src;
+
+  if((r = piperclaim(pi, 0)) <= 0)
+    return r;
+  i = 0;
+  while(i < n && (m = pipepeek(pi, 0, n - i, &src)) > 0){
+    if((r = filewrite1(f, 0, (uint64)src, m)) <= 0){
+      if(i == 0)
+        i = -1;
+      break;
+    }
+    pipeconsume(pi, r);
+    i += r;
+    if(r < m)
+      break;
+  }
+  piperunclaim(pi);
   return i;
 }
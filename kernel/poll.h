@@ -0,0 +1,11 @@
+struct pollfd {
+  int fd;        // File descriptor to watch
+  short events;  // Events of interest
+  short revents; // Events that occurred
+};
+
+#define POLLIN   0x001  // data ready to read
+#define POLLOUT  0x004  // room to write
+#define POLLERR  0x008  // write end has no reader
+#define POLLHUP  0x010  // read end has no writer
+#define POLLNVAL 0x020  // fd not open
@@ -5,11 +5,16 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "vdso.h"
+#include "trace.h"
+#include "perf.h"
 
 struct cpu cpus[NCPU];
 
 struct proc proc[NPROC];
 
+struct share shares[NPROC];
+
 struct proc *initproc;
 
 int nextpid = 1;
@@ -18,6 +23,8 @@ struct spinlock pid_lock;
 extern void forkret(void);
 static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
+static void shput(struct share *sh);
+static void asidinit(void);
 
 extern char trampoline[]; // trampoline.S
 
@@ -26,8 +33,11 @@ void
 procinit(void)
 {
   struct proc *p;
+  struct share *sh;
   
   initlock(&pid_lock, "nextpid");
+  for(sh = shares; sh < &shares[NPROC]; sh++)
+    initlock(&sh->lock, "share");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
 
@@ -42,6 +52,101 @@ procinit(void)
       p->kstack = va;
   }
   kvminithart();
+  asidinit();
+}
+
+// Address-space identifiers tag TLB entries, so that
+// switching satp between page tables needn't flush the TLB.
+// Each process gets two, for p->pagetable and p->kpagetable.
+// They are handed out in order; when they run out a new
+// generation starts, and each CPU flushes its whole TLB
+// before running any process with an ASID of the new
+// generation. ASID 0 belongs to kernel_pagetable, and to
+// everything if the hardware has no ASIDs.
+struct {
+  struct spinlock lock;
+  uint64 gen;   // current generation
+  int next;     // next free ASID in gen
+  int max;      // largest ASID, or 0 if none
+} asids;
+
+extern pagetable_t kernel_pagetable;
+
+// find out how many ASID bits satp implements.
+static void
+asidinit(void)
+{
+  initlock(&asids.lock, "asid");
+  w_satp(r_satp() | SATP_ASIDMASK);
+  asids.max = (r_satp() & SATP_ASIDMASK) >> SATP_ASIDSHIFT;
+  if(asids.max < 2)
+    asids.max = 0;
+  kvminithart();
+  asids.gen = 1;
+  asids.next = 1;
+}
+
+// Switch this CPU to p's kernel page table, giving p new
+// ASIDs if its old ones are from an earlier generation.
+// p->lock must be held.
+static void
+asidswitch(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  int id = cpuid();
+  uint64 gen;
+
+  acquire(&asids.lock);
+  if(asids.max && p->asidgen != asids.gen){
+    if(asids.next + 1 > asids.max){
+      asids.gen++;
+      asids.next = 1;
+    }
+    p->asid = asids.next++;
+    p->kasid = asids.next++;
+    p->asidgen = asids.gen;
+  }
+  gen = asids.gen;
+  release(&asids.lock);
+
+  w_satp(MAKE_SATPA(p->kpagetable, p->kasid));
+  usertrapsetup(p);
+
+  if(asids.max == 0 || c->asidgen != gen){
+    sfence_vma();
+    c->asidgen = gen;
+  } else if(p->lastcpu != id){
+    // p's page tables may have changed while it ran
+    // elsewhere; see asidflush().
+    sfence_vma_asid(p->asid);
+    sfence_vma_asid(p->kasid);
+  }
+  p->lastcpu = id;
+}
+
+// Switch this CPU back to kernel_pagetable.
+static void
+asidkernel(void)
+{
+  if(asids.max == 0){
+    kvminithart();
+    return;
+  }
+  w_satp(MAKE_SATP(kernel_pagetable));
+}
+
+// Flush this CPU's TLB entries for p's page tables after
+// changing them. Other CPUs flush them when p next runs
+// there (see asidswitch()).
+void
+asidflush(struct proc *p)
+{
+  if(asids.max == 0){
+    sfence_vma();
+    return;
+  }
+  sfence_vma_asid(p->asid);
+  sfence_vma_asid(p->kasid);
 }
 
 // Must be called with interrupts disabled,
@@ -85,6 +190,37 @@ allocpid() {
   return pid;
 }
 
+// Allocate an empty share, for a process that is not a
+// thread of another. There is one for every proc, so one is
+// always free.
+static struct share*
+shalloc(void)
+{
+  struct share *sh;
+
+  for(sh = shares; sh < &shares[NPROC]; sh++){
+    acquire(&sh->lock);
+    if(sh->ref == 0){
+      sh->ref = 1;
+      sh->vmgen = 0;
+      release(&sh->lock);
+      return sh;
+    }
+    release(&sh->lock);
+  }
+  panic("shalloc");
+}
+
+// Drop a reference to a share that holds no files, as
+// when making a process fails.
+static void
+shput(struct share *sh)
+{
+  acquire(&sh->lock);
+  sh->ref--;
+  release(&sh->lock);
+}
+
 // Look in the process table for an UNUSED proc.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
@@ -106,13 +242,29 @@ allocproc(void)
 
 found:
   p->pid = allocpid();
+  p->asidgen = 0;
+  p->lastcpu = -1;
+  memset(p->syscalls, 0, sizeof(p->syscalls));
+  p->cycles = p->instret = 0;
+  p->ccycles = p->cinstret = 0;
+  p->sh = shalloc();
+  p->vmgen = 0;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+    freeproc(p);
     release(&p->lock);
     return 0;
   }
 
+  // Allocate the page user code reads its pid from.
+  if((p->vdso = (struct vdsoproc *)kalloc_zeroed()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+  p->vdso->pid = p->pid;
+
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
   if(p->pagetable == 0){
@@ -121,6 +273,14 @@ found:
     return 0;
   }
 
+  // The kernel page table to use while running p.
+  p->kpagetable = kvmcreate();
+  if(p->kpagetable == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+
   // Set up new context to start executing at forkret,
   // which returns to user space.
   memset(&p->context, 0, sizeof(p->context));
@@ -139,9 +299,18 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
+  if(p->vdso)
+    kfree((void*)p->vdso);
+  p->vdso = 0;
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
+  if(p->kpagetable)
+    kvmfree(p->kpagetable);
+  p->kpagetable = 0;
+  if(p->sh)
+    shput(p->sh);
+  p->sh = 0;
   p->sz = 0;
   p->pid = 0;
   p->parent = 0;
@@ -182,6 +351,24 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the shared clock page and this process's
+  // vdso page below that, readable by user code.
+  if(mappages(pagetable, VDSO, PGSIZE,
+              (uint64)vdso, PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+  if(mappages(pagetable, VDSOPROC, PGSIZE,
+              (uint64)(p->vdso), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmunmap(pagetable, VDSO, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -192,6 +379,8 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, VDSO, 1, 0);
+  uvmunmap(pagetable, VDSOPROC, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -220,37 +409,109 @@ userinit(void)
   // and data into it.
   uvminit(p->pagetable, initcode, sizeof(initcode));
   p->sz = PGSIZE;
+  if(kvmcopy(p->pagetable, p->kpagetable, 0, p->sz) < 0)
+    panic("userinit: kvmcopy");
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;      // user program counter
   p->trapframe->sp = PGSIZE;  // user stack pointer
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/");
+  p->sh->cwd = namei("/");
 
   p->state = RUNNABLE;
 
   release(&p->lock);
 }
 
-// Grow or shrink user memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Grow or shrink user memory by n bytes, for every thread
+// sharing it. Return the old size, or -1 on failure.
 int
 growproc(int n)
 {
-  uint sz;
+  uint sz, oldsz;
   struct proc *p = myproc();
+  struct proc *t;
+  struct share *sh = p->sh;
 
-  sz = p->sz;
+  // a vfork() child's memory is its parent's.
+  if(p->vfork)
+    return -1;
+
+  // sh->lock keeps the threads from changing memory at
+  // once, and from coming or going while their mirrors
+  // are updated.
+  acquire(&sh->lock);
+  oldsz = sz = p->sz;
+  // sbrk(0) just asks the size; the other threads'
+  // TLBs need no flush.
+  if(n == 0){
+    release(&sh->lock);
+    return oldsz;
+  }
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
-      return -1;
+    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0)
+      goto bad;
+    for(t = proc; t < &proc[NPROC]; t++){
+      if(t->sh == sh && kvmcopy(t->pagetable, t->kpagetable, oldsz, sz) < 0){
+        for(t = proc; t < &proc[NPROC]; t++)
+          if(t->sh == sh)
+            kvmdealloc(t->kpagetable, sz, oldsz);
+        uvmdealloc(p->pagetable, sz, oldsz);
+        goto bad;
+      }
     }
   } else if(n < 0){
+    // other threads may still be using the pages through
+    // their TLBs, on other CPUs, so they cannot be freed.
+    if(sh->ref > 1)
+      goto bad;
+    kvmdealloc(p->kpagetable, sz, sz + n);
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
-  p->sz = sz;
-  return 0;
+  asidflush(p);
+  p->vmgen = ++sh->vmgen;
+  for(t = proc; t < &proc[NPROC]; t++)
+    if(t->sh == sh)
+      t->sz = sz;
+  release(&sh->lock);
+  return oldsz;
+
+ bad:
+  release(&sh->lock);
+  return -1;
+}
+
+// The threads sharing p's memory flush their TLBs lazily:
+// growproc() bumps sh->vmgen and each thread checks it when
+// it enters the kernel from user space, so a stale entry
+// can cost it at most one spurious page fault, which
+// usertrap() retries. No CPU waits for another, and user
+// memory is never freed while another thread can see it.
+// Returns 1 if p's TLB entries were flushed.
+int
+vmsync(struct proc *p)
+{
+  uint64 gen = p->sh->vmgen;
+
+  if(p->vmgen == gen)
+    return 0;
+  p->vmgen = gen;
+  asidflush(p);
+  return 1;
+}
+
+// Give to a new process the open files and current
+// directory of sh, which another thread may be changing.
+static void
+sharefiles(struct share *sh, struct share *nsh)
+{
+  acquire(&sh->lock);
+  for(int i = 0; i < NOFILE; i++)
+    if(sh->ofile[i])
+      nsh->ofile[i] = filedup(sh->ofile[i]);
+  nsh->cwd = idup(sh->cwd);
+  release(&sh->lock);
 }
 
 // Create a new process, copying the parent.
@@ -258,7 +519,7 @@ growproc(int n)
 int
 fork(void)
 {
-  int i, pid;
+  int pid;
   struct proc *np;
   struct proc *p = myproc();
 
@@ -268,7 +529,8 @@ fork(void)
   }
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0 ||
+     kvmcopy(np->pagetable, np->kpagetable, 0, p->sz) < 0){
     freeproc(np);
     release(&np->lock);
     return -1;
@@ -284,10 +546,167 @@ fork(void)
   np->trapframe->a0 = 0;
 
   // increment reference counts on open file descriptors.
+  sharefiles(p->sh, np->sh);
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  pid = np->pid;
+
+  np->state = RUNNABLE;
+
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a child that runs in the parent's memory, not a
+// copy of it, until it calls exec() or exit(). The child's
+// page tables share the parent's page-table pages for user
+// memory, so nothing is copied or mapped page by page. The
+// parent waits until the child lets go of its memory.
+int
+vfork(void)
+{
+  int pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  // Allocate process.
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+
+  // User memory lies below PLIC, all under the first
+  // entry of the root page-table page.
+  np->pagetable[0] = p->pagetable[0];
+  kvmshare(p->kpagetable, np->kpagetable);
+  np->sz = p->sz;
+  np->vfork = 1;
+
+  np->parent = p;
+
+  // copy saved user registers.
+  *(np->trapframe) = *(p->trapframe);
+
+  // Cause vfork to return 0 in the child.
+  np->trapframe->a0 = 0;
+
+  // increment reference counts on open file descriptors.
+  sharefiles(p->sh, np->sh);
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  pid = np->pid;
+
+  np->state = RUNNABLE;
+
+  // np->lock is still held from allocproc(), so the child
+  // cannot clear np->vfork before we sleep. sleep() takes
+  // our lock while holding the child's; that cannot deadlock
+  // with exit(), which takes them the other way round,
+  // because the child clears np->vfork before getting there.
+  while(np->vfork)
+    sleep(np, &np->lock);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a process running the program in path, built
+// straight from the file rather than as a copy of the
+// caller, so that the cost does not depend on the caller's
+// size. Its open files are ofile, whose references it takes
+// over; they are closed if it fails. Returns the new pid,
+// or -1.
+int
+spawn(char *path, char **argv, struct file **ofile)
+{
+  int i, argc, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == 0)
+    goto bad;
+
+  // USED keeps np from being allocated again while exec
+  // sleeps without np->lock.
+  np->state = USED;
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  release(&np->lock);
+
+  if((argc = execproc(np, path, argv)) < 0){
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    goto bad;
+  }
+
+  acquire(&np->lock);
+  for(i = 0; i < NOFILE; i++)
+    np->sh->ofile[i] = ofile[i];
+  acquire(&p->sh->lock);
+  np->sh->cwd = idup(p->sh->cwd);
+  release(&p->sh->lock);
+  np->parent = p;
+  np->trapframe->a0 = argc;
+  pid = np->pid;
+  np->state = RUNNABLE;
+  release(&np->lock);
+  return pid;
+
+ bad:
   for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
+    if(ofile[i])
+      fileclose(ofile[i]);
+  return -1;
+}
+
+// Create a thread of the caller: a process that shares its
+// memory, open files and current directory, and starts by
+// calling fn(arg) on the stack whose top is stack. Like
+// a forked child it is the caller's to wait() for.
+// Returns its pid, or -1.
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int pid;
+  struct proc *np;
+  struct proc *p = myproc();
+  struct share *sh = p->sh;
+
+  // a vfork() child's memory is its parent's.
+  if(p->vfork)
+    return -1;
+
+  if((np = allocproc()) == 0)
+    return -1;
+  shput(np->sh);
+  np->sh = 0;
+
+  // np has its own root page-table page, for its trapframe
+  // and vdso pages, and its own kernel page table.
+  acquire(&sh->lock);
+  np->pagetable[0] = p->pagetable[0];
+  if(kvmcopy(np->pagetable, np->kpagetable, 0, p->sz) < 0){
+    release(&sh->lock);
+    np->pagetable[0] = 0;
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->sz = p->sz;
+  np->sh = sh;
+  np->vmgen = sh->vmgen;
+  sh->ref++;
+  release(&sh->lock);
+
+  np->parent = p;
+
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+  np->trapframe->ra = 0;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -300,6 +719,17 @@ fork(void)
   return pid;
 }
 
+// A vfork() child p, which must no longer use its parent's
+// page-table pages, lets the parent continue.
+void
+vforkdone(struct proc *p)
+{
+  acquire(&p->lock);
+  p->vfork = 0;
+  release(&p->lock);
+  wakeup(p);
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold p->lock.
 void
@@ -337,19 +767,53 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
-    }
+  if(p->vfork){
+    // give the parent's memory back before the parent
+    // can change it.
+    p->pagetable[0] = 0;
+    kvmunmirror(p->kpagetable, 0);
+    asidflush(p);
+    p->sz = 0;
+    vforkdone(p);
+  }
+
+  // Leave p's share. The last thread closes the files and
+  // keeps the memory for freeproc() to free; the others
+  // let go of the memory now, while sh->lock keeps it from
+  // changing, so that p's page tables never point at
+  // page-table pages that are gone.
+  struct share *sh = p->sh;
+  int last;
+  acquire(&sh->lock);
+  last = sh->ref == 1;
+  if(!last){
+    sh->ref--;
+    p->pagetable[0] = 0;
+    kvmunmirror(p->kpagetable, 1);
+    asidflush(p);
+    p->sz = 0;
   }
+  p->sh = 0;
+  release(&sh->lock);
+
+  if(last){
+    // Close all open files.
+    for(int fd = 0; fd < NOFILE; fd++){
+      if(sh->ofile[fd]){
+        struct file *f = sh->ofile[fd];
+        fileclose(f);
+        sh->ofile[fd] = 0;
+      }
+    }
+
+    begin_op();
+    iput(sh->cwd);
+    end_op();
+    sh->cwd = 0;
 
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
+    // no thread is left to clone() it, so sh is free.
+    shput(sh);
+  }
 
   // we might re-parent a child to init. we can't be precise about
   // waking up init, since we can't acquire its lock once we've
@@ -426,6 +890,8 @@ wait(uint64 addr)
             release(&p->lock);
             return -1;
           }
+          p->ccycles += np->cycles + np->ccycles;
+          p->cinstret += np->instret + np->cinstret;
           freeproc(np);
           release(&np->lock);
           release(&p->lock);
@@ -472,8 +938,17 @@ scheduler(void)
         // to release its lock and then reacquire it
         // before jumping back to us.
         p->state = RUNNING;
+        p->vdso->cpu = cpuid();
         c->proc = p;
+        asidswitch(p);
+        TRACE(TR_SWITCH, p->pid, 0);
+        c->cycle0 = r_cycle();
+        c->instret0 = r_instret();
         swtch(&c->context, &p->context);
+        p->cycles += r_cycle() - c->cycle0;
+        p->instret += r_instret() - c->instret0;
+        TRACE(TR_SWITCHOUT, p->pid, p->state);
+        asidkernel();
 
         // Process is done running for now.
         // It should have changed its p->state before coming back.
@@ -483,7 +958,8 @@ scheduler(void)
       }
       release(&p->lock);
     }
-    if(found == 0) {
+    if(found == 0 && kzeroidle() == 0) {
+      // nothing to run and no free pages left to clear.
       intr_on();
       asm volatile("wfi");
     }
@@ -555,6 +1031,8 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+
+  TRACE(TR_SLEEP, (uint64)chan, (uint64)__builtin_return_address(0));
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
@@ -594,6 +1072,7 @@ wakeup(void *chan)
     acquire(&p->lock);
     if(p->state == SLEEPING && p->chan == chan) {
       p->state = RUNNABLE;
+      TRACE(TR_WAKEUP, (uint64)chan, p->pid);
     }
     release(&p->lock);
   }
@@ -635,6 +1114,42 @@ kill(int pid)
   return -1;
 }
 
+// Fill in the calling process's hardware counts,
+// including the current time slice.
+void
+procperf(struct perfstat *ps)
+{
+  struct proc *p = myproc();
+  struct cpu *c;
+
+  push_off();
+  c = mycpu();
+  ps->cycles = p->cycles + r_cycle() - c->cycle0;
+  ps->instret = p->instret + r_instret() - c->instret0;
+  pop_off();
+  ps->ccycles = p->ccycles;
+  ps->cinstret = p->cinstret;
+}
+
+// Copy process pid's system call counts to counts[].
+int
+procsyscalls(int pid, uint64 *counts)
+{
+  struct proc *p;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      for(int i = 0; i < NSYSCALL; i++)
+        counts[i] = p->syscalls[i];
+      release(&p->lock);
+      return 0;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
 // Copy to either a user address, or kernel address,
 // depending on usr_dst.
 // Returns 0 on success, -1 on error.
@@ -673,6 +1188,7 @@ procdump(void)
 {
   static char *states[] = {
   [UNUSED]    "unused",
+  [USED]      "used  ",
   [SLEEPING]  "sleep ",
   [RUNNABLE]  "runble",
   [RUNNING]   "run   ",
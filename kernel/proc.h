@@ -24,6 +24,9 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 asidgen;             // ASID generation the TLB was last flushed for
+  uint64 cycle0;              // cycle CSR when proc was switched in
+  uint64 instret0;            // instret CSR when proc was switched in
 };
 
 extern struct cpu cpus[NCPU];
@@ -78,9 +81,25 @@ struct trapframe {
   /* 264 */ uint64 t4;
   /* 272 */ uint64 t5;
   /* 280 */ uint64 t6;
+  /* 288 */ uint64 syscall;       // set by uservec if t0-t6 weren't saved
 };
 
-enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
+// What the threads of a process share: user memory, open
+// files and the current directory. Each process has one;
+// clone() makes a thread that uses its creator's. The
+// threads share user memory by sharing the page-table page
+// under the first root entry, as vfork() does, and each
+// keeps its own root page, trapframe, kernel stack and
+// mirror of user memory in its kernel page table.
+struct share {
+  struct spinlock lock;
+  int ref;                     // threads using this; 0 if free
+  uint64 vmgen;                // bumped when user mappings change
+  struct file *ofile[NOFILE];  // Open files
+  struct inode *cwd;           // Current directory
+};
+
+enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
@@ -93,14 +112,27 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int vfork;                   // Sharing parent's memory, from vfork()
+  int asid;                    // ASID of pagetable
+  int kasid;                   // ASID of kpagetable
+  uint64 asidgen;              // Generation of asid and kasid
+  int lastcpu;                 // CPU that last ran this process
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
+  uint64 sz;                   // Size of process memory (bytes); threads
+                               // change each other's under sh->lock
   pagetable_t pagetable;       // User page table
+  pagetable_t kpagetable;      // Kernel page table, mirroring user memory
   struct trapframe *trapframe; // data page for trampoline.S
+  struct vdsoproc *vdso;       // read-only page at VDSOPROC
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
+  struct share *sh;            // Memory, files and cwd; see struct share
+  uint64 vmgen;                // sh->vmgen when this thread's TLB was last flushed
   char name[16];               // Process name (debugging)
+  uint syscalls[NSYSCALL];     // System calls made, by number
+  uint64 cycles;               // Cycles run, charged by the scheduler
+  uint64 instret;              // Instructions retired, likewise
+  uint64 ccycles;              // Sums of the above for waited-for children
+  uint64 cinstret;
 };
@@ -0,0 +1,182 @@
+//
+// Sampling profiler; see prof.h.
+// Each CPU's ring has a single producer, the CPU's own timer
+// interrupt handler, which runs with interrupts off, so it
+// takes no lock; it publishes a sample by advancing head.
+// Readers serialize on prof.lock and free a slot by
+// advancing tail.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "prof.h"
+
+struct profring {
+  uint head;      // written by the CPU's timer interrupt
+  uint tail;      // written by profread()
+  uint dropped;   // samples lost because the ring was full
+  struct profsample s[PROFN];
+};
+
+struct {
+  struct spinlock lock;
+  uint dropbase;  // total of dropped[] when profiling started
+  struct profring ring[NCPU];
+} prof;
+
+int profiling;
+
+void
+profinit(void)
+{
+  initlock(&prof.lock, "prof");
+}
+
+static uint
+profdropped(void)
+{
+  uint n = 0;
+
+  for(int i = 0; i < NCPU; i++)
+    n += prof.ring[i].dropped;
+  return n;
+}
+
+// Claim the next slot in this CPU's ring, or return 0 if
+// it is full. Called with interrupts off.
+static struct profsample*
+profslot(struct proc *p, int user)
+{
+  struct profring *r = &prof.ring[cpuid()];
+  struct profsample *s;
+
+  if(r->head - r->tail >= PROFN){
+    r->dropped++;
+    return 0;
+  }
+  s = &r->s[r->head & (PROFN-1)];
+  s->cpu = cpuid();
+  s->user = user;
+  s->depth = 0;
+  if(p){
+    s->pid = p->pid;
+    safestrcpy(s->name, p->name, sizeof(s->name));
+  } else {
+    s->pid = 0;
+    s->name[0] = 0;
+  }
+  return s;
+}
+
+// Make a filled-in slot visible to profread().
+static void
+profpublish(void)
+{
+  struct profring *r = &prof.ring[cpuid()];
+
+  __sync_synchronize();
+  r->head++;
+}
+
+// Sample a timer interrupt taken in the kernel.
+// fp is kerneltrap()'s frame pointer; kernelvec makes no
+// frame of its own, so the frame it saved is that of the
+// interrupted function. The walk stays within the stack
+// page it starts on.
+void
+profkernel(uint64 sepc, uint64 fp)
+{
+  struct profsample *s;
+  uint64 lo, hi;
+
+  if((s = profslot(myproc(), 0)) == 0)
+    return;
+  s->pc[s->depth++] = sepc;
+  lo = PGROUNDDOWN(fp);
+  hi = lo + PGSIZE;
+  if(fp - 16 >= lo && fp <= hi)
+    fp = *(uint64*)(fp - 16);
+  while(s->depth < PROFDEPTH && fp - 16 >= lo && fp <= hi && (fp & 7) == 0){
+    s->pc[s->depth++] = *(uint64*)(fp - 8);
+    fp = *(uint64*)(fp - 16);
+  }
+  profpublish();
+}
+
+// Sample a timer interrupt taken in user space, walking
+// the user stack's frame pointers from the saved s0.
+void
+profuser(struct proc *p)
+{
+  struct profsample *s;
+  uint64 fp, fr[2];
+
+  if((s = profslot(p, 1)) == 0)
+    return;
+  s->pc[s->depth++] = p->trapframe->epc;
+  fp = p->trapframe->s0;
+  while(s->depth < PROFDEPTH && fp >= 16 && (fp & 7) == 0){
+    if(copyin(p->pagetable, (char*)fr, fp - 16, sizeof(fr)) < 0)
+      break;
+    s->pc[s->depth++] = fr[1];
+    if(fr[0] <= fp)
+      break;
+    fp = fr[0];
+  }
+  profpublish();
+}
+
+// Start or stop sampling. Starting discards samples
+// not yet read. Returns how many samples have been
+// dropped since sampling last started.
+int
+profctl(int on)
+{
+  int n;
+
+  acquire(&prof.lock);
+  if(on){
+    profiling = 0;
+    for(int i = 0; i < NCPU; i++)
+      prof.ring[i].tail = prof.ring[i].head;
+    prof.dropbase = profdropped();
+  }
+  n = profdropped() - prof.dropbase;
+  __sync_synchronize();
+  profiling = on;
+  release(&prof.lock);
+  return n;
+}
+
+// Copy up to n samples from all CPUs' rings to user
+// address dst. Returns the number copied.
+int
+profread(uint64 dst, int n)
+{
+  struct proc *p = myproc();
+  struct profsample s;
+  struct profring *r;
+  int i, got = 0;
+
+  acquire(&prof.lock);
+  for(i = 0; i < NCPU && got < n; i++){
+    r = &prof.ring[i];
+    while(got < n && r->tail != r->head){
+      __sync_synchronize();
+      s = r->s[r->tail & (PROFN-1)];
+      __sync_synchronize();
+      r->tail++;
+      if(copyout(p->pagetable, dst + got*sizeof(s), (char*)&s, sizeof(s)) < 0){
+        release(&prof.lock);
+        return -1;
+      }
+      got++;
+    }
+  }
+  release(&prof.lock);
+  return got;
+}
@@ -0,0 +1,17 @@
+//
+// Sampling profiler. Each timer interrupt on each CPU
+// records the interrupted pc and a frame-pointer backtrace
+// in a per-CPU ring, which profread() drains.
+//
+
+#define PROFDEPTH 8    // pcs per sample
+#define PROFN     128  // samples per CPU ring; a power of two
+
+struct profsample {
+  int pid;              // interrupted process, 0 if none
+  short cpu;
+  short user;           // 1 if taken in user mode
+  int depth;            // valid entries in pc[]
+  char name[16];        // interrupted process name
+  uint64 pc[PROFDEPTH]; // pc[0] is the sampled pc, then return addresses
+};
@@ -0,0 +1,13 @@
+// File actions for spawn(), applied in order to the child's
+// copy of the caller's open files before it starts.
+#define SPAWN_CLOSE 1   // close fd
+#define SPAWN_DUP2  2   // make fd a copy of from
+#define SPAWN_OPEN  3   // open path with mode as fd
+
+struct spawnact {
+  int op;
+  int fd;
+  int from;
+  int mode;
+  uint64 path;          // user address of path, for SPAWN_OPEN
+};
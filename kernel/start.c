@@ -38,6 +38,12 @@ start()
   w_mideleg(0xffff);
   w_sie(r_sie() | SIE_SEIE | SIE_STIE | SIE_SSIE);
 
+  // let supervisor and user mode read the time CSR, for
+  // the user library's clock (see vdso.h), and the cycle
+  // and instret CSRs, for benchmarks and perfstat().
+  w_mcounteren(r_mcounteren() | COUNTEREN_TM | COUNTEREN_CY | COUNTEREN_IR);
+  w_scounteren(r_scounteren() | COUNTEREN_TM | COUNTEREN_CY | COUNTEREN_IR);
+
   // ask for clock interrupts.
   timerinit();
 
@@ -60,7 +66,7 @@ timerinit()
   int id = r_mhartid();
 
   // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
+  int interval = TICKCYCLES; // cycles; about 1/10th second in qemu.
   *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
 
   // prepare information in scratch[] for timervec.
@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "syscall.h"
+#include "sysstat.h"
 #include "defs.h"
 
 // Fetch the uint64 at addr from the current process.
@@ -104,6 +105,23 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_tee(void);
+extern uint64 sys_sendfile(void);
+extern uint64 sys_poll(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_uring_enter(void);
+extern uint64 sys_profctl(void);
+extern uint64 sys_profread(void);
+extern uint64 sys_sysstat(void);
+extern uint64 sys_tracectl(void);
+extern uint64 sys_traceread(void);
+extern uint64 sys_perfstat(void);
+extern uint64 sys_getdents(void);
+extern uint64 sys_fstatat(void);
+extern uint64 sys_vfork(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_clone(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -127,17 +145,99 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_splice]  sys_splice,
+[SYS_tee]     sys_tee,
+[SYS_sendfile] sys_sendfile,
+[SYS_poll]    sys_poll,
+[SYS_fcntl]   sys_fcntl,
+[SYS_uring_enter] sys_uring_enter,
+[SYS_profctl] sys_profctl,
+[SYS_profread] sys_profread,
+[SYS_sysstat] sys_sysstat,
+[SYS_tracectl] sys_tracectl,
+[SYS_traceread] sys_traceread,
+[SYS_perfstat] sys_perfstat,
+[SYS_getdents] sys_getdents,
+[SYS_fstatat] sys_fstatat,
+[SYS_vfork]  sys_vfork,
+[SYS_spawn]  sys_spawn,
+[SYS_clone]  sys_clone,
 };
 
+// per-CPU counts and latency histograms, so that the
+// dispatch path takes no lock.
+static struct sysstat sysstats[NCPU];
+
+// Count a call to system call num that took dt time units.
+// The process may have moved CPU during the call, so find
+// this CPU's counters with interrupts off.
+static void
+sysaccount(struct proc *p, int num, uint64 dt)
+{
+  struct sysstat *st;
+  int b;
+
+  if(num >= NSYSCALL)
+    return;
+  for(b = 0; dt > 1 && b < NSYSHIST-1; b++)
+    dt >>= 1;
+  p->syscalls[num]++;
+  push_off();
+  st = &sysstats[cpuid()];
+  st->count[num]++;
+  st->hist[num][b]++;
+  pop_off();
+}
+
+// Copy a struct sysstat to user address dst: the sum over
+// all CPUs if pid is 0, otherwise just pid's call counts,
+// with hist[] zeroed since there are no per-process ones.
+int
+sysstatcopy(int pid, uint64 dst)
+{
+  struct proc *p = myproc();
+  uint64 count[NSYSCALL], row[NSYSHIST];
+  int n, i, b;
+
+  if(pid != 0){
+    if(procsyscalls(pid, count) < 0)
+      return -1;
+  } else {
+    for(n = 0; n < NSYSCALL; n++){
+      count[n] = 0;
+      for(i = 0; i < NCPU; i++)
+        count[n] += sysstats[i].count[n];
+    }
+  }
+  if(copyout(p->pagetable, dst, (char*)count, sizeof(count)) < 0)
+    return -1;
+
+  dst += sizeof(count);
+  for(n = 0; n < NSYSCALL; n++){
+    for(b = 0; b < NSYSHIST; b++){
+      row[b] = 0;
+      if(pid == 0)
+        for(i = 0; i < NCPU; i++)
+          row[b] += sysstats[i].hist[n][b];
+    }
+    if(copyout(p->pagetable, dst + n*sizeof(row), (char*)row, sizeof(row)) < 0)
+      return -1;
+  }
+  return 0;
+}
+
 void
 syscall(void)
 {
   int num;
+  uint64 t0;
   struct proc *p = myproc();
 
   num = p->trapframe->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    t0 = r_time();
     p->trapframe->a0 = syscalls[num]();
+    sysaccount(p, num, r_time() - t0);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
@@ -20,3 +20,20 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_splice 22
+#define SYS_tee    23
+#define SYS_sendfile 24
+#define SYS_poll   25
+#define SYS_fcntl  26
+#define SYS_uring_enter 27
+#define SYS_profctl 28
+#define SYS_profread 29
+#define SYS_sysstat 30
+#define SYS_tracectl 31
+#define SYS_traceread 32
+#define SYS_perfstat 33
+#define SYS_getdents 34
+#define SYS_fstatat 35
+#define SYS_vfork  36
+#define SYS_spawn  37
+#define SYS_clone  38
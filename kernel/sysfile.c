@@ -15,9 +15,13 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "poll.h"
+#include "spawn.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
+// The caller gets a reference to the file, which it must fileclose(),
+// since another thread may close the descriptor meanwhile.
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
@@ -26,12 +30,24 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdget(fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
-  if(pf)
-    *pf = f;
+  *pf = f;
+  return 0;
+}
+
+// Fetch file descriptor arguments 0 and 1, with a reference to each.
+static int
+argfd2(struct file **f0, struct file **f1)
+{
+  if(argfd(0, 0, f0) < 0)
+    return -1;
+  if(argfd(1, 0, f1) < 0){
+    fileclose(*f0);
+    return -1;
+  }
   return 0;
 }
 
@@ -41,14 +57,18 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *p = myproc();
+  struct share *sh = myproc()->sh;
 
+  // other threads may be allocating too.
+  acquire(&sh->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
+    if(sh->ofile[fd] == 0){
+      sh->ofile[fd] = f;
+      release(&sh->lock);
       return fd;
     }
   }
+  release(&sh->lock);
   return -1;
 }
 
@@ -60,9 +80,11 @@ sys_dup(void)
 
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  // the new descriptor takes over argfd()'s reference.
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
+  }
   return fd;
 }
 
@@ -70,25 +92,132 @@ uint64
 sys_read(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+  if(argint(2, &n) < 0 || argaddr(1, &p) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  r = fileread(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 uint64
 sys_write(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+  if(argint(2, &n) < 0 || argaddr(1, &p) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = filewrite(f, p, n);
+  fileclose(f);
+  return r;
+}
+
+// move data between two files inside the kernel;
+// one of them must be a pipe.
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n, r;
+
+  if(argint(2, &n) < 0 || argfd2(&in, &out) < 0)
+    return -1;
+  r = filesplice(in, out, n);
+  fileclose(in);
+  fileclose(out);
+  return r;
+}
+
+// duplicate data from one pipe into another.
+uint64
+sys_tee(void)
+{
+  struct file *in, *out;
+  int n, r;
+
+  if(argint(2, &n) < 0 || argfd2(&in, &out) < 0)
+    return -1;
+  r = filetee(in, out, n);
+  fileclose(in);
+  fileclose(out);
+  return r;
+}
+
+// copy data from a file to any open file.
+uint64
+sys_sendfile(void)
+{
+  struct file *out, *in;
+  int n, r;
+
+  if(argint(2, &n) < 0 || argfd2(&out, &in) < 0)
+    return -1;
+  r = filesendfile(out, in, n);
+  fileclose(in);
+  fileclose(out);
+  return r;
+}
+
+// wait for any of an array of struct pollfd to become
+// ready; the timeout is in clock ticks, -1 for none.
+uint64
+sys_poll(void)
+{
+  struct pollfd fds[NOFILE];
+  uint64 addr;
+  int nfds, timeout, n;
+  struct proc *p = myproc();
+
+  if(argaddr(0, &addr) < 0 || argint(1, &nfds) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  if(nfds < 0 || nfds > NOFILE)
+    return -1;
+  if(copyin(p->pagetable, (char*)fds, addr, nfds*sizeof(fds[0])) < 0)
+    return -1;
+  if((n = filepollwait(fds, nfds, timeout)) < 0)
+    return -1;
+  if(copyout(p->pagetable, addr, (char*)fds, nfds*sizeof(fds[0])) < 0)
+    return -1;
+  return n;
+}
+
+// get or set the O_NONBLOCK flag of an open file.
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg, r;
+
+  if(argint(1, &cmd) < 0 || argint(2, &arg) < 0 || argfd(0, 0, &f) < 0)
     return -1;
+  r = -1;
+  switch(cmd){
+  case F_GETFL:
+    r = f->nonblock ? O_NONBLOCK : 0;
+    break;
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    r = 0;
+    break;
+  }
+  fileclose(f);
+  return r;
+}
+
+// run up to n operations queued in a struct uring.
+uint64
+sys_uring_enter(void)
+{
+  uint64 addr;
+  int n;
 
-  return filewrite(f, p, n);
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return uringenter(addr, n);
 }
 
 uint64
@@ -99,7 +228,12 @@ sys_close(void)
 
   if(argfd(0, &fd, &f) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
+  if(fdremove(fd, f) < 0){
+    fileclose(f);
+    return -1;
+  }
+  // drop the descriptor's reference and argfd()'s.
+  fileclose(f);
   fileclose(f);
   return 0;
 }
@@ -109,10 +243,75 @@ sys_fstat(void)
 {
   struct file *f;
   uint64 st; // user pointer to struct stat
+  int r;
+
+  if(argaddr(1, &st) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
+}
+
+// Read up to n entries of directory fd as struct dent.
+uint64
+sys_getdents(void)
+{
+  struct file *f;
+  uint64 addr;
+  int n, r;
+
+  if(argaddr(1, &addr) < 0 || argint(2, &n) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = -1;
+  if(f->type == FD_INODE && f->readable && n >= 0){
+    begin_op();
+    r = dirents(f->ip, &f->off, addr, n);
+    end_op();
+  }
+  fileclose(f);
+  return r;
+}
+
+// Stat path, looked up relative to directory fd rather
+// than the current directory.
+uint64
+sys_fstatat(void)
+{
+  char path[MAXPATH];
+  struct inode *dp, *ip;
+  struct file *f;
+  struct stat st;
+  uint64 addr;
+  int fd;
+
+  if(argint(0, &fd) < 0 || argstr(1, path, MAXPATH) < 0 || argaddr(2, &addr) < 0)
+    return -1;
+  f = 0;
+  dp = 0;
+  if(fd != AT_FDCWD){
+    if(argfd(0, 0, &f) < 0)
+      return -1;
+    if(f->type != FD_INODE){
+      fileclose(f);
+      return -1;
+    }
+    dp = f->ip;
+  }
 
-  if(argfd(0, 0, &f) < 0 || argaddr(1, &st) < 0)
+  begin_op();
+  if((ip = nameiat(dp, path)) != 0){
+    ilock(ip);
+    stati(ip, &st);
+    iunlockput(ip);
+  }
+  end_op();
+  if(f)
+    fileclose(f);
+  if(ip == 0)
     return -1;
-  return filestat(f, st);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -283,17 +482,13 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
-uint64
-sys_open(void)
+// Open path with mode omode, as for open(), but return
+// the file rather than a file descriptor, or 0.
+static struct file*
+openfile(char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
   struct file *f;
   struct inode *ip;
-  int n;
-
-  if((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0)
-    return -1;
 
   begin_op();
 
@@ -301,33 +496,31 @@ sys_open(void)
     ip = create(path, T_FILE, 0, 0);
     if(ip == 0){
       end_op();
-      return -1;
+      return 0;
     }
   } else {
     if((ip = namei(path)) == 0){
       end_op();
-      return -1;
+      return 0;
     }
     ilock(ip);
-    if(ip->type == T_DIR && omode != O_RDONLY){
+    if(ip->type == T_DIR && (omode & ~O_NONBLOCK) != O_RDONLY){
       iunlockput(ip);
       end_op();
-      return -1;
+      return 0;
     }
   }
 
   if(ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV)){
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
+  if((f = filealloc()) == 0){
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
 
   if(ip->type == T_DEVICE){
@@ -340,6 +533,7 @@ sys_open(void)
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
 
   if((omode & O_TRUNC) && ip->type == T_FILE){
     itrunc(ip);
@@ -348,6 +542,24 @@ sys_open(void)
   iunlock(ip);
   end_op();
 
+  return f;
+}
+
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int fd, omode;
+  struct file *f;
+
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
+    return -1;
+  if((f = openfile(path, omode)) == 0)
+    return -1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
@@ -391,7 +603,7 @@ uint64
 sys_chdir(void)
 {
   char path[MAXPATH];
-  struct inode *ip;
+  struct inode *ip, *old;
   struct proc *p = myproc();
   
   begin_op();
@@ -406,25 +618,34 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(p->cwd);
+  acquire(&p->sh->lock);
+  old = p->sh->cwd;
+  p->sh->cwd = ip;
+  release(&p->sh->lock);
+  iput(old);
   end_op();
-  p->cwd = ip;
   return 0;
 }
 
-uint64
-sys_exec(void)
+static void
+freeargv(char **argv)
+{
+  for(int i = 0; i < MAXARG && argv[i] != 0; i++)
+    kfree(argv[i]);
+}
+
+// Copy the user argument vector at uargv into argv, which
+// has MAXARG entries, a page per string. On failure, frees
+// what was copied and returns -1.
+static int
+fetchargv(uint64 uargv, char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
   int i;
-  uint64 uargv, uarg;
+  uint64 uarg;
 
-  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(char*));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
+    if(i >= MAXARG){
       goto bad;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
@@ -440,17 +661,91 @@ sys_exec(void)
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
       goto bad;
   }
+  return 0;
 
-  int ret = exec(path, argv);
+ bad:
+  freeargv(argv);
+  return -1;
+}
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
+    return -1;
+  }
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
 
+  int ret = exec(path, argv);
+
+  freeargv(argv);
   return ret;
+}
+
+// Start a new process running path with arguments argv, as
+// fork() and exec() would but without copying this one. The
+// child's open files are this process's, rearranged by the
+// nacts file actions at acts.
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], apath[MAXPATH], *argv[MAXARG];
+  struct file *ofile[NOFILE], *f;
+  struct spawnact act;
+  struct proc *p = myproc();
+  uint64 uargv, uacts;
+  int i, nacts, pid;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0 ||
+     argaddr(2, &uacts) < 0 || argint(3, &nacts) < 0)
+    return -1;
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
+
+  acquire(&p->sh->lock);
+  for(i = 0; i < NOFILE; i++)
+    ofile[i] = p->sh->ofile[i] ? filedup(p->sh->ofile[i]) : 0;
+  release(&p->sh->lock);
+  for(i = 0; i < nacts; i++){
+    if(copyin(p->pagetable, (char*)&act, uacts + i*sizeof(act), sizeof(act)) < 0)
+      goto bad;
+    if(act.fd < 0 || act.fd >= NOFILE)
+      goto bad;
+    switch(act.op){
+    case SPAWN_CLOSE:
+      f = 0;
+      break;
+    case SPAWN_DUP2:
+      if(act.from < 0 || act.from >= NOFILE || ofile[act.from] == 0)
+        goto bad;
+      f = filedup(ofile[act.from]);
+      break;
+    case SPAWN_OPEN:
+      if(fetchstr(act.path, apath, MAXPATH) < 0 ||
+         (f = openfile(apath, act.mode)) == 0)
+        goto bad;
+      break;
+    default:
+      goto bad;
+    }
+    if(ofile[act.fd])
+      fileclose(ofile[act.fd]);
+    ofile[act.fd] = f;
+  }
+
+  pid = spawn(path, argv, ofile);
+  freeargv(argv);
+  return pid;
 
  bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+  for(i = 0; i < NOFILE; i++)
+    if(ofile[i])
+      fileclose(ofile[i]);
+  freeargv(argv);
   return -1;
 }
 
@@ -468,18 +763,18 @@ sys_pipe(void)
     return -1;
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
-    if(fd0 >= 0)
-      p->ofile[fd0] = 0;
-    fileclose(rf);
+    if(fd0 < 0 || fdremove(fd0, rf) == 0)
+      fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
-    fileclose(rf);
-    fileclose(wf);
+    // another thread may have closed them already.
+    if(fdremove(fd0, rf) == 0)
+      fileclose(rf);
+    if(fdremove(fd1, wf) == 0)
+      fileclose(wf);
     return -1;
   }
   return 0;
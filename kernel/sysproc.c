@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "perf.h"
 
 uint64
 sys_exit(void)
@@ -29,6 +30,22 @@ sys_fork(void)
   return fork();
 }
 
+uint64
+sys_vfork(void)
+{
+  return vfork();
+}
+
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 || argaddr(2, &stack) < 0)
+    return -1;
+  return clone(fn, arg, stack);
+}
+
 uint64
 sys_wait(void)
 {
@@ -46,8 +63,9 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  // growproc() returns the old size: another thread may
+  // move it before myproc()->sz could be read.
+  if((addr = growproc(n)) < 0)
     return -1;
   return addr;
 }
@@ -83,6 +101,84 @@ sys_kill(void)
   return kill(pid);
 }
 
+// start (1) or stop (0) the sampling profiler.
+uint64
+sys_profctl(void)
+{
+  int on;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  return profctl(on != 0);
+}
+
+// read up to n profiler samples into a
+// struct profsample array.
+uint64
+sys_profread(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  return profread(addr, n);
+}
+
+// copy system call counts and latency histograms into a
+// struct sysstat: system-wide if pid is 0, otherwise the
+// counts of process pid, whose histograms are all zero.
+uint64
+sys_sysstat(void)
+{
+  uint64 addr;
+  int pid;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  return sysstatcopy(pid, addr);
+}
+
+// enable the tracepoints in a mask of (1 << TR_*) bits.
+uint64
+sys_tracectl(void)
+{
+  int mask;
+
+  if(argint(0, &mask) < 0)
+    return -1;
+  return tracectl(mask);
+}
+
+// read up to n trace events into a
+// struct traceevent array.
+uint64
+sys_traceread(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  return traceread(addr, n);
+}
+
+// copy the calling process's cycle and instruction
+// counts into a struct perfstat.
+uint64
+sys_perfstat(void)
+{
+  struct perfstat ps;
+  uint64 addr;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  procperf(&ps);
+  if(copyout(myproc()->pagetable, addr, (char*)&ps, sizeof(ps)) < 0)
+    return -1;
+  return 0;
+}
+
 // return how many clock tick interrupts have occurred
 // since start.
 uint64
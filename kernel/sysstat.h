@@ -0,0 +1,21 @@
+//
+// System call statistics, returned by sysstat().
+// Latencies are measured with the time CSR, in units
+// of 1/TIMEBASE seconds, and binned by log2: hist[n][b]
+// counts calls to system call n that took less than 2
+// units if b is 0, otherwise [2^b, 2^(b+1)) units.
+//
+// Histograms are kept per CPU only; a histogram per
+// process would cost NSYSCALL*NSYSHIST words in each
+// struct proc. So sysstat() of a single process fills
+// in count[] and leaves every hist[] bucket zero.
+//
+
+// NSYSCALL is in param.h.
+
+#define NSYSHIST 24  // latency buckets; the last has no upper bound
+
+struct sysstat {
+  uint64 count[NSYSCALL];
+  uint64 hist[NSYSCALL][NSYSHIST];
+};
@@ -0,0 +1,126 @@
+//
+// Static tracepoints; see trace.h.
+// A CPU's ring is written only by that CPU, with interrupts
+// off, so recording an event takes no lock; the event is
+// published by advancing head. Readers serialize on
+// trace.lock and free a slot by advancing tail.
+// A disabled TRACE() costs a load and a branch.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "trace.h"
+
+struct tracering {
+  uint head;      // written by the CPU itself
+  uint tail;      // written by traceread()
+  uint dropped;   // events lost because the ring was full
+  struct traceevent e[TRACEN];
+};
+
+struct {
+  struct spinlock lock;
+  uint dropbase;  // total of dropped[] when tracing started
+  struct tracering ring[NCPU];
+} trace;
+
+uint tracemask;
+
+void
+traceinit(void)
+{
+  initlock(&trace.lock, "trace");
+}
+
+static uint
+tracedropped(void)
+{
+  uint n = 0;
+
+  for(int i = 0; i < NCPU; i++)
+    n += trace.ring[i].dropped;
+  return n;
+}
+
+// Append an event to this CPU's ring. Called by TRACE()
+// only when type is enabled.
+void
+tracerecord(int type, uint64 a0, uint64 a1)
+{
+  struct tracering *r;
+  struct traceevent *e;
+  struct proc *p;
+
+  push_off();
+  r = &trace.ring[cpuid()];
+  if(r->head - r->tail >= TRACEN){
+    r->dropped++;
+    pop_off();
+    return;
+  }
+  e = &r->e[r->head & (TRACEN-1)];
+  e->time = r_time();
+  e->a0 = a0;
+  e->a1 = a1;
+  p = mycpu()->proc;
+  e->pid = p ? p->pid : 0;
+  e->cpu = cpuid();
+  e->type = type;
+  __sync_synchronize();
+  r->head++;
+  pop_off();
+}
+
+// Set the mask of enabled tracepoints. Turning tracing
+// on discards events not yet read. Returns how many events
+// have been dropped since tracing was last turned on.
+int
+tracectl(uint mask)
+{
+  int n;
+
+  acquire(&trace.lock);
+  if(tracemask == 0 && mask != 0){
+    for(int i = 0; i < NCPU; i++)
+      trace.ring[i].tail = trace.ring[i].head;
+    trace.dropbase = tracedropped();
+  }
+  n = tracedropped() - trace.dropbase;
+  __sync_synchronize();
+  tracemask = mask;
+  release(&trace.lock);
+  return n;
+}
+
+// Copy up to n events from all CPUs' rings to user
+// address dst. Returns the number copied.
+int
+traceread(uint64 dst, int n)
+{
+  struct proc *p = myproc();
+  struct traceevent e;
+  struct tracering *r;
+  int i, got = 0;
+
+  acquire(&trace.lock);
+  for(i = 0; i < NCPU && got < n; i++){
+    r = &trace.ring[i];
+    while(got < n && r->tail != r->head){
+      __sync_synchronize();
+      e = r->e[r->tail & (TRACEN-1)];
+      __sync_synchronize();
+      r->tail++;
+      if(copyout(p->pagetable, dst + got*sizeof(e), (char*)&e, sizeof(e)) < 0){
+        release(&trace.lock);
+        return -1;
+      }
+      got++;
+    }
+  }
+  release(&trace.lock);
+  return got;
+}
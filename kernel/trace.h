@@ -0,0 +1,29 @@
+//
+// Static kernel tracepoints. Each enabled TRACE() in the
+// kernel appends a struct traceevent to its CPU's ring,
+// which traceread() drains. tracectl() takes a mask of
+// (1 << TR_*) bits to enable.
+//
+
+#define TRACEN 1024  // events per CPU ring; a power of two
+
+#define TR_SWITCH     0  // scheduler runs pid
+#define TR_SWITCHOUT  1  // pid gives up the CPU; a1: new state
+#define TR_SLEEP      2  // a0: chan, a1: caller of sleep()
+#define TR_WAKEUP     3  // a0: chan, a1: pid woken
+#define TR_DISKSUBMIT 4  // a0: block number, a1: 1 if a write
+#define TR_DISKDONE   5  // a0: block number
+#define TR_COMMIT     6  // log commit starts; a0: blocks
+#define TR_COMMITDONE 7  // log commit ends
+#define TR_PGFAULT    8  // a0: stval, a1: scause
+#define TR_LOCKWAIT   9  // a0: spinlock, a1: time spun
+#define TR_NTYPES    10
+
+struct traceevent {
+  uint64 time;  // time CSR
+  uint64 a0;
+  uint64 a1;
+  int pid;      // current process, 0 if none
+  short cpu;
+  short type;   // TR_*
+};
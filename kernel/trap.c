@@ -5,11 +5,15 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "vdso.h"
+#include "trace.h"
 
 struct spinlock tickslock;
 uint ticks;
+struct vdso *vdso;  // mapped read-only at VDSO in every process
 
 extern char trampoline[], uservec[], userret[];
+extern char ucopy[], ucopyfault[];  // ucopy.S
 
 // in kernelvec.S, calls kerneltrap().
 void kernelvec();
@@ -20,6 +24,12 @@ void
 trapinit(void)
 {
   initlock(&tickslock, "time");
+
+  if((vdso = (struct vdso*)kalloc_zeroed()) == 0)
+    panic("trapinit: vdso");
+  vdso->timebase = TIMEBASE;
+  vdso->tickcycles = TICKCYCLES;
+  vdso->boottime = r_time();
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -36,7 +46,7 @@ trapinithart(void)
 void
 usertrap(void)
 {
-  int which_dev = 0;
+  int which_dev = 0, flushed;
 
   if((r_sstatus() & SSTATUS_SPP) != 0)
     panic("usertrap: not from user mode");
@@ -49,6 +59,9 @@ usertrap(void)
   
   // save user program counter.
   p->trapframe->epc = r_sepc();
+
+  // another thread may have changed the page tables.
+  flushed = vmsync(p);
   
   if(r_scause() == 8){
     // system call
@@ -67,12 +80,20 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if(flushed && (r_scause() == 12 || r_scause() == 13 || r_scause() == 15)){
+    // the fault may have come from a TLB entry that is now
+    // gone; try again.
   } else {
+    if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15)
+      TRACE(TR_PGFAULT, r_stval(), r_scause());
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
     p->killed = 1;
   }
 
+  if(which_dev == 2 && profiling)
+    profuser(p);
+
   if(p->killed)
     exit(-1);
 
@@ -83,6 +104,21 @@ usertrap(void)
   usertrapret();
 }
 
+// set up trapframe values that uservec will need when p
+// next enters the kernel. the scheduler calls this when it
+// switches to p on this CPU, with p's kernel page table
+// installed; they only change when p moves CPU or gets new
+// ASIDs, so usertrapret() need not rewrite them on every
+// return to user space.
+void
+usertrapsetup(struct proc *p)
+{
+  p->trapframe->kernel_satp = r_satp();         // kernel page table
+  p->trapframe->kernel_sp = p->kstack + PGSIZE; // process's kernel stack
+  p->trapframe->kernel_trap = (uint64)usertrap;
+  p->trapframe->kernel_hartid = r_tp();         // hartid for cpuid()
+}
+
 //
 // return to user space
 //
@@ -99,27 +135,27 @@ usertrapret(void)
   // send syscalls, interrupts, and exceptions to trampoline.S
   w_stvec(TRAMPOLINE + (uservec - trampoline));
 
-  // set up trapframe values that uservec will need when
-  // the process next re-enters the kernel.
-  p->trapframe->kernel_satp = r_satp();         // kernel page table
-  p->trapframe->kernel_sp = p->kstack + PGSIZE; // process's kernel stack
-  p->trapframe->kernel_trap = (uint64)usertrap;
-  p->trapframe->kernel_hartid = r_tp();         // hartid for cpuid()
+  // the trapframe's kernel_* values were set up by
+  // usertrapsetup() when the scheduler switched to p.
 
   // set up the registers that trampoline.S's sret will use
   // to get to user space.
   
-  // set S Previous Privilege mode to User.
+  // set S Previous Privilege mode to User, and enable
+  // interrupts in user mode. usually they already are,
+  // so skip the CSR write when it's not needed.
   unsigned long x = r_sstatus();
-  x &= ~SSTATUS_SPP; // clear SPP to 0 for user mode
-  x |= SSTATUS_SPIE; // enable interrupts in user mode
-  w_sstatus(x);
+  if((x & (SSTATUS_SPP|SSTATUS_SPIE)) != SSTATUS_SPIE){
+    x &= ~SSTATUS_SPP; // clear SPP to 0 for user mode
+    x |= SSTATUS_SPIE; // enable interrupts in user mode
+    w_sstatus(x);
+  }
 
   // set S Exception Program Counter to the saved user pc.
   w_sepc(p->trapframe->epc);
 
   // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = MAKE_SATPA(p->pagetable, p->asid);
 
   // jump to trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
@@ -143,12 +179,24 @@ kerneltrap()
   if(intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
 
+  // a fault while ucopy.S touches user memory makes
+  // the copy return -1.
+  if((scause == 13 || scause == 15) &&
+     sepc >= (uint64)ucopy && sepc < (uint64)ucopyfault){
+    TRACE(TR_PGFAULT, r_stval(), scause);
+    w_sepc((uint64)ucopyfault);
+    return;
+  }
+
   if((which_dev = devintr()) == 0){
     printf("scause %p\n", scause);
     printf("sepc=%p stval=%p\n", r_sepc(), r_stval());
     panic("kerneltrap");
   }
 
+  if(which_dev == 2 && profiling)
+    profkernel(sepc, r_fp());
+
   // give up the CPU if this is a timer interrupt.
   if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
     yield();
@@ -162,10 +210,15 @@ kerneltrap()
 void
 clockintr()
 {
+  uint now;
+
   acquire(&tickslock);
   ticks++;
+  now = ticks;
+  vdso->ticks = ticks;
   wakeup(&ticks);
   release(&tickslock);
+  polltick(now);  // poll() timeouts
 }
 
 // check if it's an external interrupt or software interrupt,
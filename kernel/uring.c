@@ -0,0 +1,141 @@
+//
+// Batched system calls through a struct uring in user
+// memory; see uring.h. uring_enter() runs up to n queued
+// operations in a single trap, in order, each to completion.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "uring.h"
+
+// Run a two-descriptor submission on f and e->fd2.
+static int
+uringop2(struct uring_sqe *e, struct file *f)
+{
+  struct file *f2;
+  int r;
+
+  if((f2 = fdget(e->fd2)) == 0)
+    return -1;
+  switch(e->op){
+  case URING_SPLICE:
+    r = filesplice(f, f2, e->len);
+    break;
+  case URING_TEE:
+    r = filetee(f, f2, e->len);
+    break;
+  case URING_SENDFILE:
+    r = filesendfile(f, f2, e->len);
+    break;
+  default:
+    r = -1;
+  }
+  fileclose(f2);
+  return r;
+}
+
+// Run one submission and return its result. Like argfd(),
+// holds a reference to each file it uses, since another
+// thread may close the descriptor meanwhile.
+static int
+uringop(struct uring_sqe *e)
+{
+  struct file *f;
+  int r;
+
+  if(e->op == URING_NOP)
+    return 0;
+  if((f = fdget(e->fd)) == 0)
+    return -1;
+
+  switch(e->op){
+  case URING_READ:
+    r = fileread(f, e->addr, e->len);
+    break;
+  case URING_WRITE:
+    r = filewrite(f, e->addr, e->len);
+    break;
+  case URING_CLOSE:
+    r = -1;
+    if(fdremove(e->fd, f) == 0){
+      fileclose(f);
+      r = 0;
+    }
+    break;
+  case URING_FSTAT:
+    r = filestat(f, e->addr);
+    break;
+  case URING_POLL:
+    r = filepoll(f, e->len);
+    break;
+  default:
+    r = uringop2(e, f);
+  }
+  fileclose(f);
+  return r;
+}
+
+// Consume up to n sqes from the ring at user address
+// addr, posting a cqe for each. Stops early when the
+// completion queue is full or the process is killed.
+// Returns the number of cqes posted, or -1 if the ring
+// is not readable. If an entry cannot be copied partway
+// through, stops there with the work done so far published;
+// an sqe whose cqe could not be written stays consumed, so
+// that it is not run twice, and its result is lost.
+int
+uringenter(uint64 addr, int n)
+{
+  struct proc *p = myproc();
+  struct uring r;
+  struct uring_sqe e;
+  struct uring_cqe c;
+  uint64 sqa, cqa;
+  int i, skip, err;
+
+  // only the four indices; entries are copied one at a time.
+  if(copyin(p->pagetable, (char*)&r, addr, 4*sizeof(uint)) < 0)
+    return -1;
+
+  skip = 0;
+  err = 0;
+  for(i = 0; i < n && r.sq_head != r.sq_tail && !p->killed; i++){
+    if(r.cq_tail - r.cq_head >= URING_ENTRIES)
+      break;
+    sqa = addr + (uint64)&((struct uring*)0)->sq[r.sq_head % URING_ENTRIES];
+    if(copyin(p->pagetable, (char*)&e, sqa, sizeof(e)) < 0){
+      err = 1;
+      break;
+    }
+    r.sq_head++;
+
+    c.user_data = e.user_data;
+    c.pad = 0;
+    c.res = skip ? -1 : uringop(&e);
+    skip = (e.flags & URING_F_LINK) && c.res < 0;
+
+    cqa = addr + (uint64)&((struct uring*)0)->cq[r.cq_tail % URING_ENTRIES];
+    if(copyout(p->pagetable, cqa, (char*)&c, sizeof(c)) < 0){
+      err = 1;
+      break;
+    }
+    r.cq_tail++;
+  }
+
+  // publish the new indices.
+  if(copyout(p->pagetable, addr + (uint64)&((struct uring*)0)->sq_head,
+             (char*)&r.sq_head, sizeof(r.sq_head)) < 0 ||
+     copyout(p->pagetable, addr + (uint64)&((struct uring*)0)->cq_tail,
+             (char*)&r.cq_tail, sizeof(r.cq_tail)) < 0)
+    return -1;
+  if(err && i == 0)
+    return -1;
+  return i;
+}
@@ -0,0 +1,50 @@
+//
+// Submission/completion ring shared between a user
+// program and uring_enter(). The program fills sq[] and
+// advances sq_tail; the kernel consumes entries, advances
+// sq_head, and appends one cqe per sqe at cq_tail. The
+// program consumes completions by advancing cq_head.
+// Indices run freely and are reduced mod URING_ENTRIES.
+//
+
+#define URING_ENTRIES 32  // must be a power of two
+
+// sqe opcodes
+#define URING_NOP      0
+#define URING_READ     1  // read(fd, addr, len)
+#define URING_WRITE    2  // write(fd, addr, len)
+#define URING_CLOSE    3  // close(fd)
+#define URING_FSTAT    4  // fstat(fd, addr)
+#define URING_SPLICE   5  // splice(fd, fd2, len)
+#define URING_TEE      6  // tee(fd, fd2, len)
+#define URING_SENDFILE 7  // sendfile(fd, fd2, len)
+#define URING_POLL     8  // poll of fd for len events, never waits
+
+// sqe flags
+#define URING_F_LINK   0x1  // skip the next sqe if this one fails
+
+struct uring_sqe {
+  uchar op;         // URING_*
+  uchar flags;      // URING_F_*
+  ushort pad;
+  int fd;
+  uint64 addr;      // user buffer
+  int len;
+  int fd2;          // second descriptor of splice/tee/sendfile
+  uint64 user_data; // copied to the cqe
+};
+
+struct uring_cqe {
+  uint64 user_data;
+  int res;          // what the system call would have returned
+  int pad;
+};
+
+struct uring {
+  uint sq_head;     // written by the kernel
+  uint sq_tail;     // written by the program
+  uint cq_head;     // written by the program
+  uint cq_tail;     // written by the kernel
+  struct uring_sqe sq[URING_ENTRIES];
+  struct uring_cqe cq[URING_ENTRIES];
+};
@@ -0,0 +1,19 @@
+//
+// Read-only pages the kernel maps into every process,
+// so that user code can read the clock, its pid and its
+// CPU without a system call. See user/ulib.c.
+//
+
+// at VDSO; one page shared by all processes.
+struct vdso {
+  uint64 ticks;      // copy of ticks, updated by clockintr()
+  uint64 timebase;   // time CSR rate, in Hz
+  uint64 tickcycles; // time CSR cycles per tick
+  uint64 boottime;   // time CSR value when ticks was 0
+};
+
+// at VDSOPROC; one page per process.
+struct vdsoproc {
+  int pid;           // copy of p->pid
+  int cpu;           // CPU the process was last scheduled on
+};
@@ -21,8 +21,7 @@ extern char trampoline[]; // trampoline.S
 void
 kvminit()
 {
-  kernel_pagetable = (pagetable_t) kalloc();
-  memset(kernel_pagetable, 0, PGSIZE);
+  kernel_pagetable = (pagetable_t) kalloc_zeroed();
 
   // uart registers
   kvmmap(UART0, UART0, PGSIZE, PTE_R | PTE_W);
@@ -30,21 +29,30 @@ kvminit()
   // virtio mmio disk interface
   kvmmap(VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
-  // CLINT
-  kvmmap(CLINT, CLINT, 0x10000, PTE_R | PTE_W);
-
   // PLIC
   kvmmap(PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
   // map kernel text executable and read-only.
   kvmmap(KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
-  // map kernel data and the physical RAM we'll make use of.
-  kvmmap((uint64)etext, (uint64)etext, PHYSTOP-(uint64)etext, PTE_R | PTE_W);
+  // map kernel data and the physical RAM we'll make use of,
+  // with megapages from the first 2MB boundary on.
+  uint64 super = SUPERPGROUNDUP((uint64)etext);
+  if(super > (uint64)etext)
+    kvmmap((uint64)etext, (uint64)etext, super-(uint64)etext, PTE_R | PTE_W);
+  for(; super < PHYSTOP; super += SUPERPGSIZE)
+    if(mapsuper(kernel_pagetable, super, super, PTE_R | PTE_W | PTE_G) != 0)
+      panic("kvminit");
 
   // map the trampoline for trap entry/exit to
   // the highest virtual address in the kernel.
   kvmmap(TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
+
+  // the global mappings must not cover user addresses:
+  // user memory lies below PLIC, and the pages from
+  // VDSOPROC up to the trampoline are per-process.
+  if(KSTACK(0) + PGSIZE > VDSOPROC || KSTACK(NPROC-1) < PHYSTOP)
+    panic("kvminit: layout");
 }
 
 // Switch h/w page table register to the kernel's page table,
@@ -68,6 +76,9 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// If va lies in a megapage, return its level-1 PTE,
+// which has PTE_S set.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
 {
@@ -77,17 +88,84 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   for(int level = 2; level > 0; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
     if(*pte & PTE_V) {
+      if(*pte & PTE_S)
+        return pte;
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
   return &pagetable[PX(0, va)];
 }
 
+// Return the physical address of the 4KB page that
+// holds va, given the leaf PTE that maps va.
+static uint64
+leafpa(pte_t pte, uint64 va)
+{
+  uint64 pa = PTE2PA(pte);
+
+  if(pte & PTE_S)
+    pa += PGROUNDDOWN(va) - SUPERPGROUNDDOWN(va);
+  return pa;
+}
+
+// Create a megapage PTE for va, which must be aligned to
+// SUPERPGSIZE, referring to the megapage at pa. An empty
+// page-table page left behind at that slot by earlier
+// 4KB mappings is freed.
+// Returns 0 on success, -1 if the slot still holds 4KB
+// mappings or a page-table page couldn't be allocated.
+int
+mapsuper(pagetable_t pagetable, uint64 va, uint64 pa, int perm)
+{
+  pte_t *pte;
+  pagetable_t l1, l0;
+
+  if((va % SUPERPGSIZE) != 0 || (pa % SUPERPGSIZE) != 0 || va >= MAXVA)
+    panic("mapsuper");
+
+  pte = &pagetable[PX(2, va)];
+  if(*pte & PTE_V) {
+    l1 = (pagetable_t)PTE2PA(*pte);
+  } else {
+    if((l1 = (pagetable_t)kalloc_zeroed()) == 0)
+      return -1;
+    *pte = PA2PTE(l1) | PTE_V;
+  }
+
+  pte = &l1[PX(1, va)];
+  if(*pte & PTE_V){
+    if(*pte & PTE_S)
+      panic("mapsuper: remap");
+    l0 = (pagetable_t)PTE2PA(*pte);
+    for(int i = 0; i < 512; i++)
+      if(l0[i] & PTE_V)
+        return -1;
+    kfree((void*)l0);
+  }
+  *pte = PA2PTE(pa) | perm | PTE_S | PTE_V;
+  return 0;
+}
+
+// Replace the megapage PTE *pte with the page-table page
+// l0, filled with 512 PTEs that map the same memory 4KB at
+// a time, so that part of it can be unmapped or changed.
+// l0 may be one of the megapage's own pages, whose PTE the
+// caller must then clear.
+static void
+demote(pte_t *pte, pagetable_t l0)
+{
+  uint64 pa = PTE2PA(*pte);
+  int flags = PTE_FLAGS(*pte) & ~PTE_S;
+
+  for(int i = 0; i < 512; i++)
+    l0[i] = PA2PTE(pa + i*PGSIZE) | flags;
+  *pte = PA2PTE(l0) | PTE_V;
+}
+
 // Look up a virtual address, return the physical address,
 // or 0 if not mapped.
 // Can only be used to look up user pages.
@@ -107,17 +185,127 @@ walkaddr(pagetable_t pagetable, uint64 va)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  pa = PTE2PA(*pte);
+  pa = leafpa(*pte, va);
   return pa;
 }
 
+// Create a kernel page table for a process. It shares
+// the kernel's mappings, except that the first gigabyte
+// gets its own level-1 page, whose entries below PLIC
+// are left free to mirror the process's user memory
+// (see kvmcopy()). Returns 0 if out of memory.
+pagetable_t
+kvmcreate()
+{
+  pagetable_t pagetable, l1;
+  int i;
+
+  if((pagetable = (pagetable_t) kalloc()) == 0)
+    return 0;
+  if((l1 = (pagetable_t) kalloc_zeroed()) == 0){
+    kfree(pagetable);
+    return 0;
+  }
+  if(kernel_pagetable[0] & PTE_V){
+    pagetable_t kl1 = (pagetable_t)PTE2PA(kernel_pagetable[0]);
+    for(i = PX(1, PLIC); i < 512; i++)
+      l1[i] = kl1[i];
+  }
+  pagetable[0] = PA2PTE(l1) | PTE_V;
+  for(i = 1; i < 512; i++)
+    pagetable[i] = kernel_pagetable[i];
+  return pagetable;
+}
+
+// Free a page table made by kvmcreate(), including the
+// page-table pages that mirrored user memory but not the
+// user memory itself.
+void
+kvmfree(pagetable_t pagetable)
+{
+  kvmunmirror(pagetable, 1);
+  kfree((void*)PTE2PA(pagetable[0]));
+  kfree((void*)pagetable);
+}
+
+// Make kernel page table kpt mirror the same user memory
+// as from, by pointing it at from's page-table pages. For
+// vfork(); kpt must mirror nothing already.
+void
+kvmshare(pagetable_t from, pagetable_t kpt)
+{
+  pagetable_t l1 = (pagetable_t)PTE2PA(kpt[0]);
+  pagetable_t fl1 = (pagetable_t)PTE2PA(from[0]);
+
+  for(int i = 0; i < PX(1, PLIC); i++)
+    l1[i] = fl1[i];
+}
+
+// Remove kpt's whole mirror of user memory, freeing the
+// page-table pages if dofree is set; they are not kpt's to
+// free if kvmshare() put them there.
+void
+kvmunmirror(pagetable_t kpt, int dofree)
+{
+  pagetable_t l1 = (pagetable_t)PTE2PA(kpt[0]);
+
+  for(int i = 0; i < PX(1, PLIC); i++){
+    if(dofree && (l1[i] & PTE_V))
+      kfree((void*)PTE2PA(l1[i]));
+    l1[i] = 0;
+  }
+}
+
+// Mirror the user mappings of upt in [start, end) into the
+// kernel page table kpt, without PTE_U so that the kernel
+// may use them. Pages without PTE_U are left unmapped.
+// Returns 0 on success, -1 if out of memory.
+int
+kvmcopy(pagetable_t upt, pagetable_t kpt, uint64 start, uint64 end)
+{
+  pte_t *pte, *kpte;
+  uint64 a;
+
+  if(end > PLIC)
+    panic("kvmcopy");
+  for(a = PGROUNDUP(start); a < end; a += PGSIZE){
+    pte = walk(upt, a, 0);
+    if(pte && (*pte & PTE_V) && (*pte & PTE_U)){
+      if((kpte = walk(kpt, a, 1)) == 0)
+        return -1;
+      *kpte = PA2PTE(leafpa(*pte, a)) | (PTE_FLAGS(*pte) & ~(PTE_U|PTE_X|PTE_S));
+    } else if((kpte = walk(kpt, a, 0)) != 0){
+      *kpte = 0;
+    }
+  }
+  return 0;
+}
+
+// Remove the mirrored user mappings in [PGROUNDUP(newsz),
+// PGROUNDUP(oldsz)) from kernel page table kpt. Like
+// uvmdealloc(), but frees nothing.
+void
+kvmdealloc(pagetable_t kpt, uint64 oldsz, uint64 newsz)
+{
+  pte_t *pte;
+  uint64 a;
+
+  for(a = PGROUNDUP(newsz); a < PGROUNDUP(oldsz); a += PGSIZE){
+    if((pte = walk(kpt, a, 0)) != 0)
+      *pte = 0;
+  }
+}
+
 // add a mapping to the kernel page table.
 // only used when booting.
 // does not flush TLB or enable paging.
+// kernel mappings never change, so they are global:
+// TLB entries for them survive switches between
+// address spaces.
 void
 kvmmap(uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kernel_pagetable, va, sz, pa, perm) != 0)
+  if(mappages(kernel_pagetable, va, sz, pa, perm | PTE_G) != 0)
     panic("kvmmap");
 }
 
@@ -137,7 +325,7 @@ kvmpa(uint64 va)
     panic("kvmpa");
   if((*pte & PTE_V) == 0)
     panic("kvmpa");
-  pa = PTE2PA(*pte);
+  pa = leafpa(*pte, va);
   return pa+off;
 }
 
@@ -170,20 +358,47 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 // Remove npages of mappings starting from va. va must be
 // page-aligned. The mappings must exist.
 // Optionally free the physical memory.
+// A megapage that is only partly unmapped is first split
+// into 4KB mappings. That needs a page-table page; if none
+// can be allocated, the first page being freed becomes it,
+// so freeing memory never fails for want of memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, end;
   pte_t *pte;
+  pagetable_t l0;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
+  end = va + npages*PGSIZE;
+  for(a = va; a < end; a += PGSIZE){
     if((pte = walk(pagetable, a, 0)) == 0)
       panic("uvmunmap: walk");
     if((*pte & PTE_V) == 0)
       panic("uvmunmap: not mapped");
+    if(*pte & PTE_S){
+      if(a % SUPERPGSIZE == 0 && a + SUPERPGSIZE <= end){
+        if(do_free)
+          ksuperfree((void*)PTE2PA(*pte));
+        *pte = 0;
+        a += SUPERPGSIZE - PGSIZE;
+        continue;
+      }
+      if((l0 = (pagetable_t)kalloc()) == 0){
+        // only the top pages, never megapages, are
+        // unmapped without freeing them.
+        if(!do_free)
+          panic("uvmunmap: demote");
+        l0 = (pagetable_t)leafpa(*pte, a);
+        demote(pte, l0);
+        *walk(pagetable, a, 0) = 0;
+        continue;
+      }
+      demote(pte, l0);
+      pte = walk(pagetable, a, 0);
+    }
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
@@ -200,10 +415,9 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -217,8 +431,7 @@ uvminit(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
@@ -233,15 +446,28 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 
   if(newsz < oldsz)
     return oldsz;
+  // the kernel maps devices from PLIC up in every
+  // process's kernel page table (see kvmcreate()).
+  if(newsz > PLIC)
+    return 0;
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    // a megapage if a whole aligned one fits.
+    if(a % SUPERPGSIZE == 0 && newsz - a >= SUPERPGSIZE &&
+       (mem = ksuperalloc()) != 0){
+      memset(mem, 0, SUPERPGSIZE);
+      if(mapsuper(pagetable, a, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) == 0){
+        a += SUPERPGSIZE - PGSIZE;
+        continue;
+      }
+      ksuperfree(mem);
+    }
+    mem = kalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -318,8 +544,19 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
       panic("uvmcopy: pte should exist");
     if((*pte & PTE_V) == 0)
       panic("uvmcopy: page not present");
-    pa = PTE2PA(*pte);
-    flags = PTE_FLAGS(*pte);
+    flags = PTE_FLAGS(*pte) & ~PTE_S;
+    // copy a megapage whole if there's a free one,
+    // otherwise 4KB at a time.
+    if((*pte & PTE_S) && i % SUPERPGSIZE == 0 && (mem = ksuperalloc()) != 0){
+      memmove(mem, (char*)PTE2PA(*pte), SUPERPGSIZE);
+      if(mapsuper(new, i, (uint64)mem, flags) != 0){
+        ksuperfree(mem);
+        goto err;
+      }
+      i += SUPERPGSIZE - PGSIZE;
+      continue;
+    }
+    pa = leafpa(*pte, i);
     if((mem = kalloc()) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
@@ -337,15 +574,24 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
-void
+// returns 0, or -1 if a megapage could not be split.
+int
 uvmclear(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
+  pagetable_t l0;
   
   pte = walk(pagetable, va, 0);
   if(pte == 0)
     panic("uvmclear");
+  if(*pte & PTE_S){
+    if((l0 = (pagetable_t)kalloc()) == 0)
+      return -1;
+    demote(pte, l0);
+    pte = walk(pagetable, va, 0);
+  }
   *pte &= ~PTE_U;
+  return 0;
 }
 
 // Copy from kernel to user.
@@ -356,6 +602,9 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
 
+  if(uvmdirect(pagetable, dstva, len))
+    return copyout_new(pagetable, dstva, src, len);
+
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
     pa0 = walkaddr(pagetable, va0);
@@ -381,6 +630,9 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
 
+  if(uvmdirect(pagetable, srcva, len))
+    return copyin_new(pagetable, dst, srcva, len);
+
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
@@ -408,6 +660,9 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   uint64 n, va0, pa0;
   int got_null = 0;
 
+  if(uvmdirect(pagetable, srcva, 1))
+    return copyinstr_new(pagetable, dst, srcva, max);
+
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
@@ -0,0 +1,64 @@
+#include "param.h"
+#include "types.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+//
+// Each process's kernel page table (p->kpagetable) also
+// maps its user memory, without PTE_U, so the kernel can
+// copy to and from user addresses with plain loads and
+// stores instead of walking p->pagetable page by page.
+// Pages the user can't touch, such as the stack guard
+// page, are left out, and ucopy.S turns a fault on them
+// into an error return.
+//
+
+// in ucopy.S
+int ucopy(void *dst, void *src, uint64 n);
+int ucopystr(char *dst, char *src, uint64 max);
+
+// Can [va, va+len) of pagetable be reached directly
+// through the current kernel page table?
+int
+uvmdirect(pagetable_t pagetable, uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+
+  return p != 0 && pagetable == p->pagetable &&
+    va < p->sz && len <= p->sz - va;
+}
+
+// Copy len bytes to dst from user virtual address srcva.
+// The caller has checked uvmdirect().
+// Return 0 on success, -1 on error.
+int
+copyin_new(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
+{
+  return ucopy(dst, (void *)srcva, len);
+}
+
+// Copy len bytes from src to user virtual address dstva.
+// The caller has checked uvmdirect().
+// Return 0 on success, -1 on error.
+int
+copyout_new(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
+{
+  return ucopy((void *)dstva, src, len);
+}
+
+// Copy a null-terminated string from user virtual address
+// srcva, until a '\0' or max bytes. The caller has checked
+// uvmdirect() for srcva.
+// Return 0 on success, -1 on error.
+int
+copyinstr_new(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
+{
+  struct proc *p = myproc();
+
+  if(max > p->sz - srcva)
+    max = p->sz - srcva;
+  return ucopystr(dst, (char *)srcva, max);
+}
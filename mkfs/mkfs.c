@@ -129,10 +129,12 @@ main(int argc, char *argv[])
   iappend(rootino, &de, sizeof(de));
 
   for(i = 2; i < argc; i++){
-    // get rid of "user/"
+    // get rid of "user/" and "kernel/"
     char *shortname;
     if(strncmp(argv[i], "user/", 5) == 0)
       shortname = argv[i] + 5;
+    else if(strncmp(argv[i], "kernel/", 7) == 0)
+      shortname = argv[i] + 7;
     else
       shortname = argv[i];
     
@@ -249,6 +251,10 @@ balloc(int used)
   int i;
 
   printf("balloc: first %d blocks have been allocated\n", used);
+  if(used > FSSIZE){
+    fprintf(stderr, "mkfs: %d blocks do not fit in FSSIZE %d\n", used, FSSIZE);
+    exit(1);
+  }
   assert(used < BSIZE*8);
   bzero(buf, BSIZE);
   for(i = 0; i < used; i++){
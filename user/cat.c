@@ -2,17 +2,27 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 
-char buf[512];
+char buf[4096];
 
 void
 cat(int fd)
 {
   int n;
 
-  while((n = read(fd, buf, sizeof(buf))) > 0) {
-    if (write(1, buf, n) != n) {
-      fprintf(2, "cat: write error\n");
-      exit(1);
+  // let the kernel move the data when fd is a file or
+  // either end is a pipe; otherwise copy it through buf.
+  if((n = sendfile(1, fd, sizeof(buf))) >= 0){
+    while(n > 0)
+      n = sendfile(1, fd, sizeof(buf));
+  } else if((n = splice(fd, 1, sizeof(buf))) >= 0){
+    while(n > 0)
+      n = splice(fd, 1, sizeof(buf));
+  } else {
+    while((n = read(fd, buf, sizeof(buf))) > 0) {
+      if (write(1, buf, n) != n) {
+        fprintf(2, "cat: write error\n");
+        exit(1);
+      }
     }
   }
   if(n < 0){
@@ -0,0 +1,63 @@
+//
+// ctxbench: bounce a byte between two processes over a pair
+// of pipes and report the cost of one round trip, which is
+// two context switches and four system calls.
+//
+// usage: ctxbench [rounds]
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int p1[2], p2[2], i, n, pid;
+  uint64 c0, t0, c, t;
+  char b = 'x';
+
+  n = 10000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0){
+    fprintf(2, "usage: ctxbench [rounds]\n");
+    exit(1);
+  }
+
+  if(pipe(p1) < 0 || pipe(p2) < 0){
+    fprintf(2, "ctxbench: pipe failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "ctxbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(p1[1]);
+    close(p2[0]);
+    while(read(p1[0], &b, 1) == 1)
+      write(p2[1], &b, 1);
+    exit(0);
+  }
+  close(p1[0]);
+  close(p2[1]);
+
+  c0 = rdcycle();
+  t0 = rdtime();
+  for(i = 0; i < n; i++){
+    if(write(p1[1], &b, 1) != 1 || read(p2[0], &b, 1) != 1){
+      fprintf(2, "ctxbench: ping-pong failed\n");
+      exit(1);
+    }
+  }
+  c = rdcycle() - c0;
+  t = rdtime() - t0;
+  close(p1[1]);
+  wait(0);
+
+  printf("%d round trips: %d cycles, %d us each\n", n,
+         (int)(c / n), (int)(t * 1000000 / vtimebase() / n));
+  exit(0);
+}
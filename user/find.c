@@ -2,6 +2,23 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 #include "kernel/fs.h"
+#include "kernel/poll.h"
+
+// usage: find [-P N] [-o] <Dir> <filename>
+//
+// With -P N the tree is searched by N worker processes. The
+// parent keeps a queue of directories still to read and hands
+// each to an idle worker over a pipe; the worker lists it and
+// sends back, over a pipe of its own, the matching files and
+// the subdirectories, which join the queue. Matches are
+// printed as they arrive, or with -o in the order a plain
+// find would print them, once the search is over.
+
+#define NDENT 32
+// the parent keeps two descriptors per worker, and needs four
+// more while starting one: 3 + 2*(MAXWORKER-1) + 4 <= NOFILE.
+#define MAXWORKER 5
+#define MSGSZ 512
 
 char* fmtname(char *path)
 {
@@ -22,9 +39,9 @@ char* fmtname(char *path)
 }	
 
 void find(char *path,char *filename){
-	char buf[512], *p;
-	int fd;
-	struct dirent de;
+	char buf[512], *p, *q;
+	int fd, i, n;
+	struct dent *de;
 	struct stat st;
 	if((fd = open(path, 0)) < 0){  //打开路径
 		fprintf(2, "ls: cannot open %s\n", path);
@@ -39,8 +56,10 @@ void find(char *path,char *filename){
 	//printf("fstat success!\n");
 	switch(st.type){
 		case T_FILE:
-			if(strcmp(de.name,filename)==0){
-				printf("%s%s\n",path,filename);
+			for(q=path+strlen(path); q > path && q[-1] != '/'; q--)
+				;
+			if(strcmp(q,filename)==0){
+				printf("%s\n",path);
 			}
 			break;
 		case T_DIR:
@@ -51,37 +70,316 @@ void find(char *path,char *filename){
 			strcpy(buf,path);
 			p=buf+strlen(buf);
 			*p++='/';
-			while(read(fd,&de,sizeof(de))==sizeof(de)){
-				//printf("%s\n",de.name);
-				if(de.inum==0||(strcmp(de.name,".")==0)||(strcmp(de.name,"..")==0))
-					continue;
-				memmove(p,de.name,DIRSIZ);
-				p[DIRSIZ]=0;
-				//printf("%s\n",buf);
-				if(stat(buf, &st) < 0){
-					printf("find: cannot stat %s\n", buf);
-					continue;
-				}
-				if(st.type==T_FILE){
-					if(strcmp(de.name,filename)==0){
-						printf("%s\n",buf);
-					}	
-				}
-				else if(st.type==T_DIR){
-					find(buf,filename);
+			// getdents() returns the entries' types, so only
+			// directories need to be opened. one buffer per level,
+			// since the recursion would overwrite a shared one.
+			if((de=malloc(NDENT*sizeof(struct dent)))==0){
+				printf("find: out of memory\n");
+				exit(-1);
+			}
+			while((n=getdents(fd,de,NDENT))>0){
+				for(i=0;i<n;i++){
+					if((strcmp(de[i].name,".")==0)||(strcmp(de[i].name,"..")==0))
+						continue;
+					strcpy(p,de[i].name);
+					if(de[i].type==T_FILE){
+						if(strcmp(de[i].name,filename)==0){
+							printf("%s\n",buf);
+						}
+					}
+					else if(de[i].type==T_DIR){
+						find(buf,filename);
+					}
 				}
 			}
+			free(de);
 			break;
 	}
 	close(fd);
 }
 
+// a directory in the queue
+struct task {
+	char *path;
+	// with -o, what the search of this directory found, in
+	// order: 'm' and a matching path, or 'd' and the index of
+	// the subdirectory's task.
+	char *out;
+	int nout, cap;
+};
+
+struct worker {
+	int cmd, res;   // pipes to and from it
+	int task;       // index of the task it is on, or -1
+	char in[2*MSGSZ];
+	int nin;
+};
+
+struct task *tasks;
+int ntask, taskcap;
+struct worker workers[MAXWORKER];
+int ordered;
+
+// messages a worker has yet to send
+char wbuf[MSGSZ];
+int wn;
+
+void* grow(void *old, int n, int cap){
+	void *p;
+	if((p=malloc(cap))==0){
+		printf("find: out of memory\n");
+		exit(-1);
+	}
+	if(old){
+		memmove(p,old,n);
+		free(old);
+	}
+	return p;
+}
+
+int addtask(char *path){
+	struct task *t;
+	if(ntask==taskcap){
+		taskcap=taskcap ? 2*taskcap : 64;
+		tasks=grow(tasks,ntask*sizeof(struct task),taskcap*sizeof(struct task));
+	}
+	t=&tasks[ntask];
+	t->path=grow(0,0,strlen(path)+1);
+	strcpy(t->path,path);
+	t->out=0;
+	t->nout=t->cap=0;
+	return ntask++;
+}
+
+void addout(struct task *t, int type, char *s, int n){
+	while(t->nout+1+n>t->cap){
+		t->cap=t->cap ? 2*t->cap : 256;
+		t->out=grow(t->out,t->nout,t->cap);
+	}
+	t->out[t->nout++]=type;
+	memmove(t->out+t->nout,s,n);
+	t->nout+=n;
+}
+
+// print a finished search in the order find() would.
+void printtask(int i){
+	struct task *t=&tasks[i];
+	int k, c;
+	for(k=0;k<t->nout;){
+		if(t->out[k++]=='m'){
+			printf("%s\n",t->out+k);
+			k+=strlen(t->out+k)+1;
+		} else {
+			memmove(&c,t->out+k,sizeof(c));
+			k+=sizeof(c);
+			printtask(c);
+		}
+	}
+}
+
+void wflush(int fd){
+	if(wn>0 && write(fd,wbuf,wn)!=wn)
+		exit(-1);
+	wn=0;
+}
+
+void wsend(int fd, int type, char *s){
+	int n=strlen(s)+1;
+	if(wn+1+n>sizeof(wbuf))
+		wflush(fd);
+	wbuf[wn++]=type;
+	memmove(wbuf+wn,s,n);
+	wn+=n;
+}
+
+// list one directory for the parent.
+void scan(char *path, char *filename, int res){
+	// leave room in a message for its type byte.
+	char buf[MSGSZ-1], *p;
+	struct dent de[NDENT];
+	int fd, i, n;
+	if((fd=open(path,0))<0){
+		fprintf(2, "find: cannot open %s\n", path);
+		return;
+	}
+	if((strlen(path)+1+DIRSIZ+1)>sizeof(buf)){
+		printf("find:path too long\n");
+		close(fd);
+		return;
+	}
+	strcpy(buf,path);
+	p=buf+strlen(buf);
+	*p++='/';
+	while((n=getdents(fd,de,NDENT))>0){
+		for(i=0;i<n;i++){
+			if((strcmp(de[i].name,".")==0)||(strcmp(de[i].name,"..")==0))
+				continue;
+			strcpy(p,de[i].name);
+			if(de[i].type==T_FILE && strcmp(de[i].name,filename)==0)
+				wsend(res,'m',buf);
+			else if(de[i].type==T_DIR)
+				wsend(res,'d',buf);
+		}
+	}
+	close(fd);
+}
+
+void work(int cmd, int res, char *filename){
+	char path[MSGSZ];
+	int n, m;
+	for(;;){
+		// the parent sends one path, null-terminated, at a time.
+		for(m=0; m==0 || path[m-1]!=0; m+=n){
+			if(m==sizeof(path) || (n=read(cmd,path+m,sizeof(path)-m))<=0)
+				exit(0);
+		}
+		scan(path,filename,res);
+		wsend(res,'e',"");
+		wflush(res);
+	}
+}
+
+// handle one message from worker w.
+void received(struct worker *w, int type, char *s){
+	int c;
+	if(type=='m'){
+		if(ordered)
+			addout(&tasks[w->task],'m',s,strlen(s)+1);
+		else
+			printf("%s\n",s);
+	} else if(type=='d'){
+		c=addtask(s);
+		if(ordered)
+			addout(&tasks[w->task],'d',(char*)&c,sizeof(c));
+	} else {
+		w->task=-1;
+	}
+}
+
+void pfind(char *path, char *filename, int nworker){
+	struct pollfd pfd[MAXWORKER];
+	struct worker *w;
+	int c[2], r[2], i, j, k, n, next, busy;
+
+	for(i=0;i<nworker;i++){
+		// with other descriptors open there may not be room
+		// for every worker; make do with those started.
+		if(pipe(c)<0)
+			break;
+		if(pipe(r)<0){
+			close(c[0]);
+			close(c[1]);
+			break;
+		}
+		if((n=fork())<0){
+			printf("find: fork failed\n");
+			exit(-1);
+		}
+		if(n==0){
+			close(c[1]);
+			close(r[0]);
+			for(j=0;j<i;j++){
+				close(workers[j].cmd);
+				close(workers[j].res);
+			}
+			work(c[0],r[1],filename);
+		}
+		close(c[0]);
+		close(r[1]);
+		workers[i].cmd=c[1];
+		workers[i].res=r[0];
+		workers[i].task=-1;
+		workers[i].nin=0;
+	}
+	if(i==0){
+		printf("find: pipe failed\n");
+		exit(-1);
+	}
+	nworker=i;
+
+	addtask(path);
+	next=0;
+	for(;;){
+		// hand queued directories to idle workers.
+		busy=0;
+		for(i=0;i<nworker;i++){
+			w=&workers[i];
+			if(w->task<0 && next<ntask){
+				w->task=next++;
+				n=strlen(tasks[w->task].path)+1;
+				if(write(w->cmd,tasks[w->task].path,n)!=n){
+					printf("find: worker died\n");
+					exit(-1);
+				}
+			}
+			if(w->task>=0){
+				pfd[busy].fd=w->res;
+				pfd[busy].events=POLLIN;
+				busy++;
+			}
+		}
+		if(busy==0)
+			break;
+		if(poll(pfd,busy,-1)<0){
+			printf("find: poll failed\n");
+			exit(-1);
+		}
+		for(k=0;k<busy;k++){
+			if(pfd[k].revents==0)
+				continue;
+			for(w=workers; w->res!=pfd[k].fd; w++)
+				;
+			if((n=read(w->res,w->in+w->nin,sizeof(w->in)-w->nin))<=0){
+				printf("find: worker died\n");
+				exit(-1);
+			}
+			w->nin+=n;
+			// take every whole message: a type byte and a string.
+			for(i=0;;i=j+1){
+				for(j=i+1; j<w->nin && w->in[j]!=0; j++)
+					;
+				if(j>=w->nin)
+					break;
+				received(w,w->in[i],w->in+i+1);
+			}
+			w->nin-=i;
+			memmove(w->in,w->in+i,w->nin);
+		}
+	}
+
+	for(i=0;i<nworker;i++){
+		close(workers[i].cmd);
+		close(workers[i].res);
+	}
+	for(i=0;i<nworker;i++)
+		wait(0);
+	if(ordered)
+		printtask(0);
+}
+
 int main(int argc,char *argv[]){
-	if(argc!=3){
-		printf("find <Dir> <filename>\n");
+	struct stat st;
+	int i, nworker=0;
+
+	for(i=1; i<argc && argv[i][0]=='-'; i++){
+		if(strcmp(argv[i],"-o")==0)
+			ordered=1;
+		else if(strcmp(argv[i],"-P")==0 && i+1<argc)
+			nworker=atoi(argv[++i]);
+		else
+			break;
+	}
+	if(argc-i!=2 || nworker<0){
+		printf("find [-P N] [-o] <Dir> <filename>\n");
 		exit(-1);
 	}
-	find(argv[1],argv[2]);
+	if(nworker>MAXWORKER)
+		nworker=MAXWORKER;
+	// one process, or a plain file to match, needs no workers.
+	if(nworker<=1 || stat(argv[i],&st)<0 || st.type!=T_DIR)
+		find(argv[i],argv[i+1]);
+	else
+		pfind(argv[i],argv[i+1],nworker);
 	exit(0);
 }
 
@@ -1,105 +1,416 @@
 // Simple grep.  Only supports ^ . * $ operators.
+//
+// The pattern is compiled once into a list of items, each a
+// byte or '.', possibly starred. Lines are matched by a DFA
+// whose states are sets of items, built lazily as input
+// bytes need them, so each byte costs one table lookup.
+// A pattern that is a plain string is found with
+// Boyer-Moore-Horspool instead. Input is read BUFSZ bytes at
+// a time and matching lines are gathered for output.
+//
+// usage: grep [-c] [-r] pattern [file ...]
+//   -c  print the number of matching lines instead
+//   -r  search directories recursively
 
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/fs.h"
 #include "user/user.h"
 
-char buf[1024];
-int match(char*, char*);
+#define NITEM   62          // pattern items; one bit each, plus accept
+#define NDSTATE 64          // DFA states cached
+#define BUFSZ   (64*1024)
+#define OUTSZ   8192
+
+char buf[BUFSZ];
+char obuf[OUTSZ];
+int nout;
+
+int cflag, rflag, prefix;
+char *fname;     // file being searched, for prefix
+int count;       // matching lines in it
+
+// the compiled pattern
+int bol, eol;            // anchored by ^, $
+int literal;             // no . or *, no anchors
+char lit[NITEM];
+int nitem;
+uint64 itemmask[256];    // items that match each byte
+uint64 starmask;         // starred items
+uint64 accept;           // bit for having matched every item
+uint64 start;            // item set before the first byte
+int skip[256];           // Boyer-Moore-Horspool shift, for literal
+
+// the DFA; state 0 is always start.
+uint64 dset[NDSTATE];
+char dstop[NDSTATE];     // the line's fate is known: match, or dead
+short dnext[NDSTATE][256];
+int ndstate;
 
 void
-grep(char *pattern, int fd)
+flushout(void)
 {
-  int n, m;
-  char *p, *q;
+  if(nout > 0)
+    write(1, obuf, nout);
+  nout = 0;
+}
 
-  m = 0;
-  while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
-    m += n;
-    buf[m] = '\0';
-    p = buf;
-    while((q = strchr(p, '\n')) != 0){
-      *q = 0;
-      if(match(pattern, p)){
-        *q = '\n';
-        write(1, p, q+1 - p);
-      }
-      p = q+1;
+void
+emit(char *p, int n)
+{
+  if(n > OUTSZ){
+    flushout();
+    write(1, p, n);
+    return;
+  }
+  if(nout + n > OUTSZ)
+    flushout();
+  memmove(obuf + nout, p, n);
+  nout += n;
+}
+
+void
+emitint(int n)
+{
+  char b[12];
+  int i = sizeof(b);
+
+  do {
+    b[--i] = '0' + n % 10;
+    n /= 10;
+  } while(n > 0);
+  emit(b + i, sizeof(b) - i);
+}
+
+void
+compile(char *re)
+{
+  int i, c, star;
+
+  if(re[0] == '^'){
+    bol = 1;
+    re++;
+  }
+  literal = !bol;
+  nitem = 0;
+  for(i = 0; re[i]; ){
+    c = re[i] & 0xff;
+    if(c == '$' && re[i+1] == '\0'){
+      eol = 1;
+      literal = 0;
+      break;
+    }
+    star = re[i+1] == '*';
+    if(nitem == NITEM){
+      fprintf(2, "grep: pattern too long\n");
+      exit(1);
     }
-    if(m > 0){
-      m -= p - buf;
-      memmove(buf, p, m);
+    if(c == '.' || star)
+      literal = 0;
+    if(c == '.'){
+      for(int x = 0; x < 256; x++)
+        itemmask[x] |= 1L << nitem;
+    } else {
+      itemmask[c] |= 1L << nitem;
     }
+    if(star)
+      starmask |= 1L << nitem;
+    lit[nitem++] = c;
+    i += star ? 2 : 1;
   }
+  accept = 1L << nitem;
+
+  if(literal && nitem > 0){
+    for(c = 0; c < 256; c++)
+      skip[c] = nitem;
+    for(i = 0; i < nitem - 1; i++)
+      skip[lit[i] & 0xff] = nitem - 1 - i;
+  } else {
+    literal = 0;
+  }
+}
+
+// add the items reachable by skipping starred items.
+uint64
+closure(uint64 s)
+{
+  uint64 t;
+
+  while((t = s | ((s & starmask) << 1)) != s)
+    s = t;
+  return s;
 }
 
+// the DFA state for item set s, or -1 if the cache is full.
 int
-main(int argc, char *argv[])
+dstate(uint64 s)
 {
-  int fd, i;
-  char *pattern;
+  int i;
 
-  if(argc <= 1){
-    fprintf(2, "usage: grep pattern [file ...]\n");
-    exit(1);
+  for(i = 0; i < ndstate; i++)
+    if(dset[i] == s)
+      return i;
+  if(ndstate == NDSTATE)
+    return -1;
+  dset[i] = s;
+  dstop[i] = s == 0 || ((s & accept) && !eol);
+  for(int c = 0; c < 256; c++)
+    dnext[i][c] = -1;
+  ndstate++;
+  return i;
+}
+
+void
+dinit(void)
+{
+  ndstate = 0;
+  start = closure(1);
+  dstate(start);
+}
+
+// compute and cache the transition from state d on byte c.
+int
+dstep(int d, int c)
+{
+  uint64 m, s;
+  int t;
+
+  m = dset[d] & itemmask[c];
+  s = closure(((m & ~starmask) << 1) | (m & starmask));
+  if(!bol)
+    s |= start;
+  if((t = dstate(s)) < 0){
+    dinit();
+    return dstate(s);
   }
-  pattern = argv[1];
+  dnext[d][c] = t;
+  return t;
+}
 
-  if(argc <= 2){
-    grep(pattern, 0);
-    exit(0);
+// the first newline in [p, e), or e, looking at a word
+// at a time once p is aligned.
+char*
+findnl(char *p, char *e)
+{
+  uint64 w;
+
+  while(p < e && ((uint64)p & 7) != 0){
+    if(*p == '\n')
+      return p;
+    p++;
   }
+  while(p + 8 <= e){
+    w = *(uint64*)p ^ 0x0a0a0a0a0a0a0a0aL;
+    if((w - 0x0101010101010101L) & ~w & 0x8080808080808080L)
+      break;
+    p += 8;
+  }
+  while(p < e && *p != '\n')
+    p++;
+  return p;
+}
 
-  for(i = 2; i < argc; i++){
-    if((fd = open(argv[i], 0)) < 0){
-      printf("grep: cannot open %s\n", argv[i]);
-      exit(1);
-    }
-    grep(pattern, fd);
-    close(fd);
+// does the line [p, e) match?
+int
+matchline(char *p, char *e)
+{
+  int d, t;
+
+  d = 0;
+  if(dstop[d])
+    return dset[d] != 0;
+  for(; p < e; p++){
+    if((t = dnext[d][*p & 0xff]) < 0)
+      t = dstep(d, *p & 0xff);
+    d = t;
+    if(dstop[d])
+      return dset[d] != 0;
   }
-  exit(0);
+  return (dset[d] & accept) != 0;
 }
 
-// Regexp matcher from Kernighan & Pike,
-// The Practice of Programming, Chapter 9.
+// a line [p, e) matched; e is its newline, or the
+// end of a last line that has none.
+void
+found(char *p, char *e)
+{
+  count++;
+  if(cflag)
+    return;
+  if(prefix){
+    emit(fname, strlen(fname));
+    emit(":", 1);
+  }
+  emit(p, e - p);
+  emit("\n", 1);
+}
 
-int matchhere(char*, char*);
-int matchstar(int, char*, char*);
+// find the pattern string in [p, e), or return 0.
+char*
+bmh(char *p, char *e)
+{
+  int last = nitem - 1;
+  char *h;
+  int i;
 
-int
-match(char *re, char *text)
-{
-  if(re[0] == '^')
-    return matchhere(re+1, text);
-  do{  // must look at empty string
-    if(matchhere(re, text))
-      return 1;
-  }while(*text++ != '\0');
+  for(h = p; h + nitem <= e; h += skip[h[last] & 0xff]){
+    for(i = last; i >= 0 && h[i] == lit[i]; i--)
+      ;
+    if(i < 0)
+      return h;
+  }
   return 0;
 }
 
-// matchhere: search for re at beginning of text
-int matchhere(char *re, char *text)
+// search the whole lines in [p, e). the last one may
+// lack a newline.
+void
+search(char *p, char *e)
 {
-  if(re[0] == '\0')
-    return 1;
-  if(re[1] == '*')
-    return matchstar(re[0], re+2, text);
-  if(re[0] == '$' && re[1] == '\0')
-    return *text == '\0';
-  if(*text!='\0' && (re[0]=='.' || re[0]==*text))
-    return matchhere(re+1, text+1);
-  return 0;
+  char *q, *h;
+
+  if(literal){
+    while(p < e && (h = bmh(p, e)) != 0){
+      for(q = h; q > p && q[-1] != '\n'; q--)
+        ;
+      p = findnl(h, e);
+      found(q, p);
+      p++;
+    }
+    return;
+  }
+  while(p < e){
+    q = findnl(p, e);
+    if(matchline(p, q))
+      found(p, q);
+    p = q + 1;
+  }
 }
 
-// matchstar: search for c*re at beginning of text
-int matchstar(int c, char *re, char *text)
+void
+grep(int fd)
 {
-  do{  // a * matches zero or more instances
-    if(matchhere(re, text))
-      return 1;
-  }while(*text!='\0' && (*text++==c || c=='.'));
-  return 0;
+  int n, m;
+  char *nl;
+
+  count = 0;
+  m = 0;
+  while((n = read(fd, buf+m, sizeof(buf)-m)) > 0){
+    m += n;
+    for(nl = buf + m; nl > buf && nl[-1] != '\n'; nl--)
+      ;
+    if(nl == buf){
+      if(m < sizeof(buf))
+        continue;
+      nl = buf + m;  // a line longer than buf; take what we have
+    }
+    search(buf, nl);
+    m -= nl - buf;
+    memmove(buf, nl, m);
+  }
+  if(m > 0)
+    search(buf, buf + m);
+
+  if(cflag){
+    if(prefix){
+      emit(fname, strlen(fname));
+      emit(":", 1);
+    }
+    emitint(count);
+    emit("\n", 1);
+  }
+}
+
+void grepdir(char*, int);
+
+void
+grepfile(char *path, int top)
+{
+  struct stat st;
+  int fd;
+
+  if((fd = open(path, 0)) < 0){
+    if(top){
+      flushout();
+      printf("grep: cannot open %s\n", path);
+      exit(1);
+    }
+    fprintf(2, "grep: cannot open %s\n", path);
+    return;
+  }
+  if(fstat(fd, &st) < 0){
+    fprintf(2, "grep: cannot stat %s\n", path);
+  } else if(st.type == T_DIR){
+    if(rflag)
+      grepdir(path, fd);
+    else
+      fprintf(2, "grep: %s is a directory\n", path);
+  } else {
+    fname = path;
+    grep(fd);
+  }
+  close(fd);
+}
+
+void
+grepdir(char *path, int fd)
+{
+  char name[512], *p;
+  struct dirent de;
+
+  if(strlen(path) + 1 + DIRSIZ + 1 > sizeof name){
+    fprintf(2, "grep: path too long\n");
+    return;
+  }
+  strcpy(name, path);
+  p = name + strlen(name);
+  *p++ = '/';
+  while(read(fd, &de, sizeof(de)) == sizeof(de)){
+    if(de.inum == 0)
+      continue;
+    if(strcmp(de.name, ".") == 0 || strcmp(de.name, "..") == 0)
+      continue;
+    memmove(p, de.name, DIRSIZ);
+    p[DIRSIZ] = 0;
+    grepfile(name, 0);
+  }
 }
 
+int
+main(int argc, char *argv[])
+{
+  int i;
+
+  for(i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++){
+    if(strcmp(argv[i], "-c") == 0)
+      cflag = 1;
+    else if(strcmp(argv[i], "-r") == 0)
+      rflag = 1;
+    else
+      break;
+  }
+  if(i >= argc){
+    fprintf(2, "usage: grep [-c] [-r] pattern [file ...]\n");
+    exit(1);
+  }
+  compile(argv[i++]);
+  dinit();
+
+  if(i >= argc){
+    if(rflag){
+      prefix = 1;
+      grepfile(".", 1);
+    } else {
+      fname = "";
+      grep(0);
+    }
+    flushout();
+    exit(0);
+  }
+
+  prefix = rflag || argc - i > 1;
+  for(; i < argc; i++)
+    grepfile(argv[i], 1);
+  flushout();
+  exit(0);
+}
@@ -0,0 +1,98 @@
+//
+// Kernel symbol lookup for prof and ktrace, from the
+// kernel.sym that mkfs puts in the root directory.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+struct sym {
+  uint64 addr;
+  char *name;
+};
+
+static struct sym *syms;
+static int nsym;
+
+// read kernel.sym, lines of "<hex address> <name>",
+// into syms[], sorted by address.
+void
+loadksyms(char *path)
+{
+  struct stat st;
+  char *buf, *p, *e;
+  struct sym t;
+  int fd, i, j, gap, n;
+
+  if((fd = open(path, O_RDONLY)) < 0){
+    fprintf(2, "cannot open %s\n", path);
+    return;
+  }
+  if(fstat(fd, &st) < 0 || (buf = malloc(st.size + 1)) == 0){
+    close(fd);
+    return;
+  }
+  for(i = 0; i < st.size; i += n)
+    if((n = read(fd, buf + i, st.size - i)) <= 0)
+      break;
+  close(fd);
+  buf[i] = 0;
+
+  n = 0;
+  for(p = buf; *p; p++)
+    if(*p == '\n')
+      n++;
+  if((syms = malloc((n + 1) * sizeof(struct sym))) == 0)
+    return;
+
+  for(p = buf; *p; p = e){
+    for(e = p; *e && *e != '\n'; e++)
+      ;
+    if(*e)
+      *e++ = 0;
+    t.addr = 0;
+    for(; *p && *p != ' '; p++){
+      if(*p >= '0' && *p <= '9')
+        t.addr = t.addr*16 + *p - '0';
+      else if(*p >= 'a' && *p <= 'f')
+        t.addr = t.addr*16 + *p - 'a' + 10;
+    }
+    if(*p != ' ' || t.addr == 0)
+      continue;
+    t.name = p + 1;
+    syms[nsym++] = t;
+  }
+
+  for(gap = nsym/2; gap > 0; gap /= 2)
+    for(i = gap; i < nsym; i++)
+      for(j = i - gap; j >= 0 && syms[j].addr > syms[j+gap].addr; j -= gap){
+        t = syms[j];
+        syms[j] = syms[j+gap];
+        syms[j+gap] = t;
+      }
+}
+
+// the symbol containing pc, or 0; if off is not 0,
+// *off is set to pc's offset into the symbol.
+char*
+ksym(uint64 pc, uint64 *off)
+{
+  int lo = 0, hi = nsym - 1, mid, best = -1;
+
+  while(lo <= hi){
+    mid = (lo + hi) / 2;
+    if(syms[mid].addr <= pc){
+      best = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  if(best < 0)
+    return 0;
+  if(off)
+    *off = pc - syms[best].addr;
+  return syms[best].name;
+}
@@ -0,0 +1,182 @@
+//
+// ktrace: run a command with kernel tracepoints enabled and
+// print the events from all CPUs as one timeline, in time
+// order, one per line:
+//
+//   <microseconds> cpu<n> pid<n> <event> <details>
+//
+// kernel addresses are shown as symbol+offset from
+// /kernel.sym.
+//
+// usage: ktrace [-m mask] command [args...]
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/poll.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+#define MAXEV   16384  // events kept
+#define NREAD   64     // events per traceread()
+#define PERIOD  1      // ticks between drains
+
+char *states[] = { "unused", "sleeping", "runnable", "running", "zombie" };
+
+struct traceevent *ev;
+int nev;
+int lost;
+
+void
+drain(void)
+{
+  static struct traceevent buf[NREAD];
+  int i, n;
+
+  while((n = traceread(buf, NREAD)) > 0){
+    for(i = 0; i < n; i++){
+      if(nev == MAXEV)
+        lost++;
+      else
+        ev[nev++] = buf[i];
+    }
+  }
+}
+
+void
+sortevents(void)
+{
+  struct traceevent t;
+  int gap, i, j;
+
+  for(gap = nev/2; gap > 0; gap /= 2)
+    for(i = gap; i < nev; i++)
+      for(j = i - gap; j >= 0 && ev[j].time > ev[j+gap].time; j -= gap){
+        t = ev[j];
+        ev[j] = ev[j+gap];
+        ev[j+gap] = t;
+      }
+}
+
+void
+printaddr(uint64 a)
+{
+  uint64 off;
+  char *name;
+
+  if((name = ksym(a, &off)) != 0)
+    printf("%s+%x", name, (int)off);
+  else
+    printf("%p", a);
+}
+
+void
+printevent(struct traceevent *e, uint64 t0)
+{
+  printf("%d cpu%d pid%d ", (int)((e->time - t0) * 1000000 / vtimebase()),
+         e->cpu, e->pid);
+  switch(e->type){
+  case TR_SWITCH:
+    printf("run");
+    break;
+  case TR_SWITCHOUT:
+    printf("stop %s", e->a1 < sizeof(states)/sizeof(states[0]) ? states[e->a1] : "?");
+    break;
+  case TR_SLEEP:
+    printf("sleep chan ");
+    printaddr(e->a0);
+    printf(" from ");
+    printaddr(e->a1);
+    break;
+  case TR_WAKEUP:
+    printf("wakeup pid%d chan ", (int)e->a1);
+    printaddr(e->a0);
+    break;
+  case TR_DISKSUBMIT:
+    printf("disk %s block %d", e->a1 ? "write" : "read", (int)e->a0);
+    break;
+  case TR_DISKDONE:
+    printf("disk done block %d", (int)e->a0);
+    break;
+  case TR_COMMIT:
+    printf("commit %d blocks", (int)e->a0);
+    break;
+  case TR_COMMITDONE:
+    printf("commit done");
+    break;
+  case TR_PGFAULT:
+    printf("fault va %p scause %d", e->a0, (int)e->a1);
+    break;
+  case TR_LOCKWAIT:
+    printf("spin ");
+    printaddr(e->a0);
+    printf(" %dus", (int)(e->a1 * 1000000 / vtimebase()));
+    break;
+  default:
+    printf("event %d", e->type);
+  }
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct pollfd pfd;
+  int p[2], pid, i, dropped;
+  uint mask;
+  char c;
+
+  mask = (1 << TR_NTYPES) - 1;
+  if(argc > 2 && strcmp(argv[1], "-m") == 0){
+    mask = atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
+  if(argc < 2 || mask == 0){
+    fprintf(2, "usage: ktrace [-m mask] command [args...]\n");
+    exit(1);
+  }
+  if((ev = malloc(MAXEV * sizeof(ev[0]))) == 0){
+    fprintf(2, "ktrace: out of memory\n");
+    exit(1);
+  }
+  loadksyms("/kernel.sym");
+
+  // the command holds the write end of p until it and
+  // all its children have exited.
+  if(pipe(p) < 0){
+    fprintf(2, "ktrace: pipe failed\n");
+    exit(1);
+  }
+  tracectl(mask);
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "ktrace: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(p[0]);
+    exec(argv[1], argv + 1);
+    fprintf(2, "ktrace: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  close(p[1]);
+
+  pfd.fd = p[0];
+  pfd.events = POLLIN;
+  for(;;){
+    drain();
+    if(poll(&pfd, 1, PERIOD) > 0 && read(p[0], &c, 1) <= 0)
+      break;
+  }
+  dropped = tracectl(0);
+  drain();
+  wait(0);
+
+  sortevents();
+  for(i = 0; i < nev; i++)
+    printevent(&ev[i], ev[0].time);
+  if(dropped || lost)
+    fprintf(2, "ktrace: %d events dropped, %d lost\n", dropped, lost);
+  exit(0);
+}
@@ -0,0 +1,86 @@
+//
+// mallocbench: time malloc() and free() in cycles per
+// operation, for back-to-back pairs, for a pool of live
+// blocks of random sizes replaced in random order, and
+// for large blocks.
+//
+// usage: mallocbench [ops]
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NLIVE 256
+
+static uint seed = 1;
+static void *live[NLIVE];
+
+static uint
+rand(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+static void
+report(char *name, uint64 c, int ops)
+{
+  if(ops == 0)
+    return;
+  printf("%s: %d cycles per op\n", name, (int)(c / ops));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, n;
+  uint64 c0;
+  void *p;
+
+  n = 100000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0){
+    fprintf(2, "usage: mallocbench [ops]\n");
+    exit(1);
+  }
+
+  c0 = rdcycle();
+  for(i = 0; i < n; i++){
+    if((p = malloc(16 + (i & 7) * 24)) == 0){
+      fprintf(2, "mallocbench: out of memory\n");
+      exit(1);
+    }
+    free(p);
+  }
+  report("pairs", rdcycle() - c0, 2*n);
+
+  c0 = rdcycle();
+  for(i = 0; i < n; i++){
+    j = rand() % NLIVE;
+    free(live[j]);
+    if((live[j] = malloc(rand() % 512)) == 0){
+      fprintf(2, "mallocbench: out of memory\n");
+      exit(1);
+    }
+  }
+  report("random", rdcycle() - c0, 2*n);
+  for(j = 0; j < NLIVE; j++){
+    free(live[j]);
+    live[j] = 0;
+  }
+
+  c0 = rdcycle();
+  for(i = 0; i < n / 10; i++){
+    j = rand() % 16;
+    free(live[j]);
+    if((live[j] = malloc(8192 + rand() % 65536)) == 0){
+      fprintf(2, "mallocbench: out of memory\n");
+      exit(1);
+    }
+  }
+  report("large", rdcycle() - c0, 2*(n/10));
+
+  exit(0);
+}
@@ -0,0 +1,99 @@
+//
+// membench: bytes per cycle of memset, memmove and memcmp
+// (the word-at-a-time versions shared with kernel/string.c)
+// against plain byte loops, for a range of sizes.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MAXSZ (64*1024)
+#define TOTAL (4*1024*1024)  // bytes moved per measurement
+#define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+
+char src[MAXSZ + 8], dst[MAXSZ + 8];
+
+static void
+byteset(void *d, int c, uint n)
+{
+  char *p = d;
+  while(n-- > 0)
+    *p++ = c;
+}
+
+static void
+bytemove(void *d, const void *s, uint n)
+{
+  char *p = d;
+  const char *q = s;
+  while(n-- > 0)
+    *p++ = *q++;
+}
+
+static int
+bytecmp(const void *a, const void *b, uint n)
+{
+  const uchar *p = a, *q = b;
+  for(; n > 0; n--, p++, q++)
+    if(*p != *q)
+      return *p - *q;
+  return 0;
+}
+
+enum { SET, MOVE, MOVEU, CMP, BSET, BMOVE, BCMP, NOP };
+char *opname[NOP] = {
+  "memset", "memmove", "memmove+1", "memcmp",
+  "byteset", "bytemove", "bytecmp",
+};
+
+// cycles to run op over n bytes enough times to touch TOTAL bytes.
+uint64
+run(int op, int n)
+{
+  int i, iters = TOTAL / n;
+  uint64 t0;
+  volatile int sink = 0;
+
+  t0 = rdcycle();
+  for(i = 0; i < iters; i++){
+    switch(op){
+    case SET:   memset(dst, i, n); break;
+    case MOVE:  memmove(dst, src, n); break;
+    case MOVEU: memmove(dst, src + 1, n); break;
+    case CMP:   sink += memcmp(dst, src, n); break;
+    case BSET:  byteset(dst, i, n); break;
+    case BMOVE: bytemove(dst, src, n); break;
+    case BCMP:  sink += bytecmp(dst, src, n); break;
+    }
+  }
+  return rdcycle() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int sizes[] = { 16, 64, 256, 1024, 4096, MAXSZ };
+  int i, op, n;
+  uint64 c, r;
+
+  memset(src, 'x', sizeof(src));
+  memset(dst, 'x', sizeof(dst));
+  printf("bytes/cycle");
+  for(i = 0; i < NELEM(sizes); i++)
+    printf("\t%d", sizes[i]);
+  printf("\n");
+  for(op = 0; op < NOP; op++){
+    printf("%s", opname[op]);
+    for(i = 0; i < NELEM(sizes); i++){
+      n = sizes[i];
+      c = run(op, n);
+      if(c == 0)
+        c = 1;
+      r = (uint64)TOTAL / n * n * 100 / c;
+      printf("\t%d.%d%d", (int)(r / 100), (int)(r / 10 % 10), (int)(r % 10));
+    }
+    printf("\n");
+  }
+  exit(0);
+}
@@ -0,0 +1,68 @@
+//
+// perf: run a command and report the cycles and
+// instructions it and its children ran, and their ratio.
+//
+// usage: perf command [args...]
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/perf.h"
+#include "user/user.h"
+
+// print a 64-bit count, which %d would truncate.
+void
+printcount(uint64 n)
+{
+  char buf[24];
+  int i = sizeof(buf);
+
+  buf[--i] = 0;
+  do {
+    buf[--i] = '0' + n % 10;
+    n /= 10;
+  } while(n != 0);
+  printf("%s", buf + i);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct perfstat before, after;
+  uint64 cycles, instret, ipc, t0, t;
+  int pid;
+
+  if(argc < 2){
+    fprintf(2, "usage: perf command [args...]\n");
+    exit(1);
+  }
+
+  perfstat(&before);
+  t0 = rdtime();
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "perf: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "perf: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  t = rdtime() - t0;
+  perfstat(&after);
+
+  cycles = after.ccycles - before.ccycles;
+  instret = after.cinstret - before.cinstret;
+  ipc = cycles ? instret * 100 / cycles : 0;
+
+  printcount(cycles);
+  printf(" cycles\n");
+  printcount(instret);
+  printf(" instructions\n");
+  printf("%d.%d%d IPC\n", (int)(ipc / 100), (int)(ipc / 10 % 10), (int)(ipc % 10));
+  printcount(t * 1000 / vtimebase());
+  printf(" ms elapsed\n");
+  exit(0);
+}
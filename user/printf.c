@@ -1,15 +1,102 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/param.h"
 #include "user/user.h"
 
 #include <stdarg.h>
 
 static char digits[] = "0123456789ABCDEF";
 
+#define STDIOBUF 512
+
+// output buffers, one per descriptor. a buffer's mode is
+// chosen when it is first used: stderr and devices such as
+// the console are written out at the end of each printf
+// call, files and pipes only when the buffer fills.
+static struct {
+  int mode;   // STDIO_*, or 0 if not yet chosen
+  int n;      // bytes in buf
+  char buf[STDIOBUF];
+} out[NOFILE];
+
+extern int (*stdiosync)(int);
+
+static int
+flushone(int fd)
+{
+  int n = out[fd].n;
+
+  out[fd].n = 0;
+  if(n > 0 && write(fd, out[fd].buf, n) != n)
+    return -1;
+  return 0;
+}
+
+// write out fd's buffer, or all buffers if fd is -1.
+int
+fflush(int fd)
+{
+  int r = 0;
+
+  if(fd < 0){
+    for(fd = 0; fd < NOFILE; fd++)
+      if(flushone(fd) < 0)
+        r = -1;
+    return r;
+  }
+  if(fd >= NOFILE)
+    return 0;
+  return flushone(fd);
+}
+
+// called by close() in ulib.c: the descriptor
+// may be reused for a different kind of file.
+static int
+sync(int fd)
+{
+  int r = fflush(fd);
+
+  if(fd >= 0 && fd < NOFILE)
+    out[fd].mode = 0;
+  return r;
+}
+
+int
+setbufmode(int fd, int mode)
+{
+  if(fd < 0 || fd >= NOFILE || mode < STDIO_UNBUF || mode > STDIO_FULL)
+    return -1;
+  fflush(fd);
+  out[fd].mode = mode;
+  stdiosync = sync;
+  return 0;
+}
+
+static int
+bufmode(int fd)
+{
+  struct stat st;
+
+  if(out[fd].mode == 0){
+    if(fd == 2 || fstat(fd, &st) < 0 || st.type == T_DEVICE)
+      out[fd].mode = STDIO_UNBUF;
+    else
+      out[fd].mode = STDIO_FULL;
+  }
+  stdiosync = sync;
+  return out[fd].mode;
+}
+
 static void
 putc(int fd, char c)
 {
-  write(fd, &c, 1);
+  if(fd < 0 || fd >= NOFILE){
+    write(fd, &c, 1);
+    return;
+  }
+  out[fd].buf[out[fd].n++] = c;
+  if(out[fd].n == STDIOBUF || (c == '\n' && out[fd].mode == STDIO_LINE))
+    flushone(fd);
 }
 
 static void
@@ -54,6 +141,9 @@ vprintf(int fd, const char *fmt, va_list ap)
   char *s;
   int c, i, state;
 
+  if(fd >= 0 && fd < NOFILE)
+    bufmode(fd);
+
   state = 0;
   for(i = 0; fmt[i]; i++){
     c = fmt[i] & 0xff;
@@ -92,6 +182,9 @@ vprintf(int fd, const char *fmt, va_list ap)
       state = 0;
     }
   }
+
+  if(fd >= 0 && fd < NOFILE && out[fd].mode == STDIO_UNBUF)
+    flushone(fd);
 }
 
 void
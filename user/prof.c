@@ -0,0 +1,148 @@
+//
+// prof: run a command under the kernel's sampling profiler
+// and print the samples as folded stacks, one line per
+// distinct stack with its count, root first, ready for
+// flamegraph.pl. kernel frames are symbolized against
+// /kernel.sym and marked _[k]; user frames are left as
+// addresses.
+//
+// usage: prof command [args...]
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/poll.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+#define NSTACK  512  // distinct stacks kept
+#define NREAD   32   // samples per profread()
+#define PERIOD  5    // ticks between drains
+
+struct stack {
+  struct profsample s;
+  int count;
+};
+
+struct stack stacks[NSTACK];
+int nstacks;
+int lost;
+
+int
+samestack(struct profsample *a, struct profsample *b)
+{
+  if(a->user != b->user || a->depth != b->depth)
+    return 0;
+  if(strcmp(a->name, b->name) != 0)
+    return 0;
+  return memcmp(a->pc, b->pc, a->depth * sizeof(a->pc[0])) == 0;
+}
+
+void
+addsample(struct profsample *s)
+{
+  int i;
+
+  for(i = 0; i < nstacks; i++){
+    if(samestack(&stacks[i].s, s)){
+      stacks[i].count++;
+      return;
+    }
+  }
+  if(nstacks == NSTACK){
+    lost++;
+    return;
+  }
+  stacks[nstacks].s = *s;
+  stacks[nstacks].count = 1;
+  nstacks++;
+}
+
+void
+drain(void)
+{
+  static struct profsample buf[NREAD];
+  int i, n;
+
+  while((n = profread(buf, NREAD)) > 0)
+    for(i = 0; i < n; i++)
+      addsample(&buf[i]);
+}
+
+void
+printframe(struct profsample *s, int i)
+{
+  char *name;
+
+  // a return address may be just past the end of the
+  // calling function, so look up the call instruction.
+  if(!s->user && (name = ksym(i == 0 ? s->pc[i] : s->pc[i] - 1, 0)) != 0)
+    printf(";%s_[k]", name);
+  else
+    printf(";%p", s->pc[i]);
+}
+
+void
+printstacks(void)
+{
+  struct profsample *s;
+  int i, j;
+
+  for(i = 0; i < nstacks; i++){
+    s = &stacks[i].s;
+    printf("%s", s->pid ? s->name : "[idle]");
+    for(j = s->depth - 1; j >= 0; j--)
+      printframe(s, j);
+    printf(" %d\n", stacks[i].count);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct pollfd pfd;
+  int p[2], pid, dropped;
+  char c;
+
+  if(argc < 2){
+    fprintf(2, "usage: prof command [args...]\n");
+    exit(1);
+  }
+  loadksyms("/kernel.sym");
+
+  // the command holds the write end of p until it and
+  // all its children have exited.
+  if(pipe(p) < 0){
+    fprintf(2, "prof: pipe failed\n");
+    exit(1);
+  }
+  profctl(1);
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "prof: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(p[0]);
+    exec(argv[1], argv + 1);
+    fprintf(2, "prof: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  close(p[1]);
+
+  pfd.fd = p[0];
+  pfd.events = POLLIN;
+  for(;;){
+    drain();
+    if(poll(&pfd, 1, PERIOD) > 0 && read(p[0], &c, 1) <= 0)
+      break;
+  }
+  dropped = profctl(0);
+  drain();
+  wait(0);
+
+  printstacks();
+  if(dropped || lost)
+    fprintf(2, "prof: %d samples dropped, %d stacks lost\n", dropped, lost);
+  exit(0);
+}
@@ -49,9 +49,20 @@ struct backcmd {
   struct cmd *cmd;
 };
 
+// Background jobs, which the shell waits for itself.
+#define NJOB 16
+
+struct job {
+  int pid;
+  char line[100];
+} jobs[NJOB];
+
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+int runchild(struct cmd*, int*, int);
+void echo(char**);
+void freecmd(struct cmd*);
 
 __attribute__((noreturn))
 // Execute cmd.  Never returns.
@@ -76,6 +87,10 @@ runcmd(struct cmd *cmd)
     ecmd = (struct execcmd*)cmd;
     if(ecmd->argv[0] == 0)
       exit(1);
+    if(strcmp(ecmd->argv[0], "echo") == 0){
+      echo(ecmd->argv);
+      exit(0);
+    }
     exec(ecmd->argv[0], ecmd->argv);
     fprintf(2, "exec %s failed\n", ecmd->argv[0]);
     break;
@@ -92,8 +107,7 @@ runcmd(struct cmd *cmd)
 
   case LIST:
     lcmd = (struct listcmd*)cmd;
-    if(fork1() == 0)
-      runcmd(lcmd->left);
+    runchild(lcmd->left, 0, 0);
     wait(0);
     runcmd(lcmd->right);
     break;
@@ -102,20 +116,8 @@ runcmd(struct cmd *cmd)
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
-    if(fork1() == 0){
-      close(1);
-      dup(p[1]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->left);
-    }
-    if(fork1() == 0){
-      close(0);
-      dup(p[0]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->right);
-    }
+    runchild(pcmd->left, p, 1);
+    runchild(pcmd->right, p, 0);
     close(p[0]);
     close(p[1]);
     wait(0);
@@ -124,13 +126,200 @@ runcmd(struct cmd *cmd)
 
   case BACK:
     bcmd = (struct backcmd*)cmd;
-    if(fork1() == 0)
-      runcmd(bcmd->cmd);
+    runchild(bcmd->cmd, 0, 0);
     break;
   }
   exit(0);
 }
 
+// Does cmd go straight to exec(), after at most some
+// redirections?
+int
+spawnable(struct cmd *cmd)
+{
+  while(cmd->type == REDIR)
+    cmd = ((struct redircmd*)cmd)->cmd;
+  return cmd->type == EXEC;
+}
+
+// Start a child running cmd and return its pid. If p is not
+// 0, the child's fd (0 or 1) is made the same end of pipe p.
+// A command that goes straight to exec() is started with
+// vfork(), which copies no memory; one that forks and waits
+// itself would hold the shell up meanwhile, so gets a copy.
+int
+runchild(struct cmd *cmd, int *p, int fd)
+{
+  int pid;
+
+  // the vfork() child shares our stdio buffers.
+  fflush(-1);
+  if(spawnable(cmd)){
+    // the child runs on our stack and in our memory until
+    // it execs or exits. It may only set up descriptors
+    // (pipe ends, redirections), run echo, report a failure
+    // with fprintf and then exec() or exit(); it must never
+    // return from runcmd() or change anything we use after
+    // it is done. spawnable() admits only commands that
+    // runcmd() handles that way.
+    if((pid = vfork()) == -1)
+      panic("vfork");
+  } else {
+    pid = fork1();
+  }
+  if(pid == 0){
+    if(p){
+      close(fd);
+      dup(p[fd]);
+      close(p[0]);
+      close(p[1]);
+    }
+    runcmd(cmd);
+  }
+  return pid;
+}
+
+// Print the arguments with a single write.
+void
+echo(char **argv)
+{
+  char buf[256];
+  int i, n, m;
+
+  n = 0;
+  for(i = 1; argv[i]; i++){
+    m = strlen(argv[i]);
+    if(n + m + 1 > sizeof(buf)){
+      write(1, buf, n);
+      n = 0;
+    }
+    if(m + 1 > sizeof(buf)){
+      write(1, argv[i], m);
+      m = 0;
+    }
+    memmove(buf + n, argv[i], m);
+    n += m;
+    buf[n++] = argv[i+1] ? ' ' : '\n';
+  }
+  if(i == 1)
+    buf[n++] = '\n';
+  write(1, buf, n);
+}
+
+// Forget background job pid, which has exited.
+void
+jobdone(int pid)
+{
+  int i;
+
+  for(i = 0; i < NJOB; i++){
+    if(jobs[i].pid == pid){
+      fprintf(2, "[%d] done %s\n", i+1, jobs[i].line);
+      jobs[i].pid = 0;
+    }
+  }
+}
+
+void
+addjob(int pid, char *line)
+{
+  int i;
+
+  for(i = 0; i < NJOB; i++){
+    if(jobs[i].pid == 0){
+      jobs[i].pid = pid;
+      strcpy(jobs[i].line, line);
+      fprintf(2, "[%d] %d\n", i+1, pid);
+      return;
+    }
+  }
+  // no room to track it; it will be reaped unannounced.
+  fprintf(2, "%d\n", pid);
+}
+
+int
+njobs(void)
+{
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < NJOB; i++)
+    if(jobs[i].pid)
+      n++;
+  return n;
+}
+
+// Wait for child pid, noting any background jobs that
+// exit meanwhile.
+void
+waitfor(int pid)
+{
+  int w;
+
+  while((w = wait(0)) >= 0 && w != pid)
+    jobdone(w);
+}
+
+// Run a command the shell handles itself. Returns 0 if
+// argv is not one.
+int
+builtin(char **argv)
+{
+  int i, pid;
+
+  if(strcmp(argv[0], "cd") == 0){
+    // Chdir must be called by the parent, not the child.
+    if(argv[1] == 0 || chdir(argv[1]) < 0)
+      fprintf(2, "cannot cd %s\n", argv[1] ? argv[1] : "");
+  } else if(strcmp(argv[0], "echo") == 0){
+    echo(argv);
+  } else if(strcmp(argv[0], "exit") == 0){
+    exit(argv[1] ? atoi(argv[1]) : 0);
+  } else if(strcmp(argv[0], "wait") == 0){
+    while(njobs() > 0 && (pid = wait(0)) >= 0)
+      jobdone(pid);
+  } else if(strcmp(argv[0], "jobs") == 0){
+    for(i = 0; i < NJOB; i++)
+      if(jobs[i].pid)
+        printf("[%d] %d %s\n", i+1, jobs[i].pid, jobs[i].line);
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+// Run cmd, typed as line, from the shell process itself
+// where that saves a fork: builtins, the parts of a list,
+// and starting background jobs. Anything else runs in a
+// child, which the shell waits for.
+void
+runtop(struct cmd *cmd, char *line)
+{
+  struct execcmd *ecmd;
+  struct listcmd *lcmd;
+  struct backcmd *bcmd;
+
+  switch(cmd->type){
+  case EXEC:
+    ecmd = (struct execcmd*)cmd;
+    if(ecmd->argv[0] == 0 || builtin(ecmd->argv))
+      return;
+    break;
+
+  case LIST:
+    lcmd = (struct listcmd*)cmd;
+    runtop(lcmd->left, line);
+    runtop(lcmd->right, line);
+    return;
+
+  case BACK:
+    bcmd = (struct backcmd*)cmd;
+    addjob(runchild(bcmd->cmd, 0, 0), line);
+    return;
+  }
+  waitfor(runchild(cmd, 0, 0));
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -145,7 +334,8 @@ getcmd(char *buf, int nbuf)
 int
 main(void)
 {
-  static char buf[100];
+  static char buf[100], line[100];
+  struct cmd *cmd;
   int fd;
 
   // Ensure that three file descriptors are open.
@@ -158,16 +348,15 @@ main(void)
 
   // Read and run input commands.
   while(getcmd(buf, sizeof(buf)) >= 0){
-    if(buf[0] == 'c' && buf[1] == 'd' && buf[2] == ' '){
-      // Chdir must be called by the parent, not the child.
-      buf[strlen(buf)-1] = 0;  // chop \n
-      if(chdir(buf+3) < 0)
-        fprintf(2, "cannot cd %s\n", buf+3);
-      continue;
-    }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait(0);
+    strcpy(line, buf);
+    if(line[0] && line[strlen(line)-1] == '\n')
+      line[strlen(line)-1] = 0;  // chop \n
+    // Parse in the shell, so that builtins and vfork() can
+    // run from the parse; a syntax error just skips the line.
+    cmd = parsecmd(buf);
+    if(cmd)
+      runtop(cmd, line);
+    freecmd(cmd);
   }
   exit(0);
 }
@@ -257,6 +446,36 @@ backcmd(struct cmd *subcmd)
   cmd->cmd = subcmd;
   return (struct cmd*)cmd;
 }
+
+// Free a parsed command, now that the shell parses
+// every line itself.
+void
+freecmd(struct cmd *cmd)
+{
+  if(cmd == 0)
+    return;
+
+  switch(cmd->type){
+  case REDIR:
+    freecmd(((struct redircmd*)cmd)->cmd);
+    break;
+
+  case PIPE:
+    freecmd(((struct pipecmd*)cmd)->left);
+    freecmd(((struct pipecmd*)cmd)->right);
+    break;
+
+  case LIST:
+    freecmd(((struct listcmd*)cmd)->left);
+    freecmd(((struct listcmd*)cmd)->right);
+    break;
+
+  case BACK:
+    freecmd(((struct backcmd*)cmd)->cmd);
+    break;
+  }
+  free(cmd);
+}
 //PAGEBREAK!
 // Parsing
 
@@ -325,18 +544,38 @@ struct cmd *parsepipe(char**, char*);
 struct cmd *parseexec(char**, char*);
 struct cmd *nulterminate(struct cmd*);
 
+// The first syntax error in the line being parsed. The
+// parser carries on after one, so as to return a whole
+// command tree for freecmd().
+char *syntaxerr;
+
+void
+synerr(char *msg)
+{
+  if(syntaxerr == 0)
+    syntaxerr = msg;
+}
+
+// Parse s. On a syntax error, print it and return 0
+// after freeing what was parsed.
 struct cmd*
 parsecmd(char *s)
 {
   char *es;
   struct cmd *cmd;
 
+  syntaxerr = 0;
   es = s + strlen(s);
   cmd = parseline(&s, es);
   peek(&s, es, "");
   if(s != es){
     fprintf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    synerr("syntax");
+  }
+  if(syntaxerr){
+    fprintf(2, "%s\n", syntaxerr);
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -380,8 +619,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      synerr("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -406,8 +647,10 @@ parseblock(char **ps, char *es)
     panic("parseblock");
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
-  if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+  if(!peek(ps, es, ")")){
+    synerr("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -432,13 +675,17 @@ parseexec(char **ps, char *es)
   while(!peek(ps, es, "|)&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      synerr("syntax");
+      break;
+    }
+    if(argc >= MAXARGS-1){
+      synerr("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -0,0 +1,73 @@
+//
+// syscallbench: time the round trip of a null system call
+// (getpid) against a plain function call and the vdso
+// vgetpid(), in cycles, instructions and nanoseconds per call.
+// each figure is the best of several runs, to keep timer
+// interrupts and preemption out of it.
+//
+// usage: syscallbench [calls]
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define RUNS 5
+
+static int n;
+
+// keep the compiler from folding the loop away.
+int
+nullfn(void) __attribute__((noinline));
+
+int
+nullfn(void)
+{
+  asm volatile("");
+  return 0;
+}
+
+void
+bench(char *name, int (*fn)(void))
+{
+  uint64 c0, i0, t0, c, in, t, bestc, besti, bestt;
+  int i, r;
+
+  bestc = besti = bestt = ~0ULL;
+  for(r = 0; r < RUNS; r++){
+    c0 = rdcycle();
+    i0 = rdinstret();
+    t0 = rdtime();
+    for(i = 0; i < n; i++)
+      fn();
+    c = rdcycle() - c0;
+    in = rdinstret() - i0;
+    t = rdtime() - t0;
+    if(c < bestc)
+      bestc = c;
+    if(in < besti)
+      besti = in;
+    if(t < bestt)
+      bestt = t;
+  }
+  printf("%s: %d cycles, %d instructions, %d ns per call\n", name,
+         (int)(bestc / n), (int)(besti / n),
+         (int)(bestt * 1000000000 / vtimebase() / n));
+}
+
+int
+main(int argc, char *argv[])
+{
+  n = 100000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0){
+    fprintf(2, "usage: syscallbench [calls]\n");
+    exit(1);
+  }
+
+  bench("function", nullfn);
+  bench("vgetpid", vgetpid);
+  bench("getpid", getpid);
+  exit(0);
+}
@@ -0,0 +1,150 @@
+//
+// sysstat: print system call counts and latency histograms.
+//
+// usage: sysstat                  system-wide totals since boot
+//        sysstat -p pid           counts for one process, which
+//                                 has no histograms of its own
+//        sysstat command [args]   system-wide, while command runs
+//
+// each histogram bucket is shown as lower-bound:count.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/syscall.h"
+#include "kernel/sysstat.h"
+#include "user/user.h"
+
+char *names[NSYSCALL] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_read]    "read",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_fstat]   "fstat",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_sleep]   "sleep",
+[SYS_uptime]  "uptime",
+[SYS_open]    "open",
+[SYS_write]   "write",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_close]   "close",
+[SYS_splice]  "splice",
+[SYS_tee]     "tee",
+[SYS_sendfile] "sendfile",
+[SYS_poll]    "poll",
+[SYS_fcntl]   "fcntl",
+[SYS_uring_enter] "uring_enter",
+[SYS_profctl] "profctl",
+[SYS_profread] "profread",
+[SYS_sysstat] "sysstat",
+[SYS_tracectl] "tracectl",
+[SYS_traceread] "traceread",
+[SYS_perfstat] "perfstat",
+[SYS_getdents] "getdents",
+[SYS_fstatat] "fstatat",
+[SYS_vfork]  "vfork",
+[SYS_spawn]  "spawn",
+[SYS_clone]  "clone",
+};
+
+struct sysstat before, after;
+
+// print a duration of u time units.
+void
+printtime(uint64 u)
+{
+  uint64 ns = u * 1000000000 / vtimebase();
+
+  if(ns >= 1000000)
+    printf("%dms", (int)(ns / 1000000));
+  else if(ns >= 1000)
+    printf("%dus", (int)(ns / 1000));
+  else
+    printf("%dns", (int)ns);
+}
+
+void
+print(struct sysstat *st, int hist)
+{
+  int n, b;
+
+  for(n = 1; n < NSYSCALL; n++){
+    if(st->count[n] == 0)
+      continue;
+    if(names[n])
+      printf("%s", names[n]);
+    else
+      printf("#%d", n);
+    printf(" %d", (int)st->count[n]);
+    if(hist){
+      for(b = 0; b < NSYSHIST; b++){
+        if(st->hist[n][b] == 0)
+          continue;
+        printf(" ");
+        printtime(b == 0 ? 0 : 1L << b);
+        printf(":%d", (int)st->hist[n][b]);
+      }
+    }
+    printf("\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, b, pid;
+
+  if(argc == 1){
+    if(sysstat(0, &after) < 0){
+      fprintf(2, "sysstat: failed\n");
+      exit(1);
+    }
+    print(&after, 1);
+    exit(0);
+  }
+
+  if(strcmp(argv[1], "-p") == 0){
+    if(argc != 3){
+      fprintf(2, "usage: sysstat -p pid\n");
+      exit(1);
+    }
+    if(sysstat(atoi(argv[2]), &after) < 0){
+      fprintf(2, "sysstat: no process %s\n", argv[2]);
+      exit(1);
+    }
+    print(&after, 0);
+    exit(0);
+  }
+
+  sysstat(0, &before);
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "sysstat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "sysstat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  sysstat(0, &after);
+
+  for(n = 0; n < NSYSCALL; n++){
+    after.count[n] -= before.count[n];
+    for(b = 0; b < NSYSHIST; b++)
+      after.hist[n][b] -= before.hist[n][b];
+  }
+  print(&after, 1);
+  exit(0);
+}
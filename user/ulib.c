@@ -1,8 +1,72 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/vdso.h"
 #include "user/user.h"
 
+// set by printf.c once it holds buffered output: flushes
+// fd's buffer, or every buffer if fd is -1.
+int (*stdiosync)(int fd);
+
+// output buffered by printf.c must be written before the
+// process is copied, replaced or ended, and before the
+// descriptor it belongs to is closed.
+int
+fork(void)
+{
+  if(stdiosync)
+    stdiosync(-1);
+  return _fork();
+}
+
+int
+exit(int status)
+{
+  if(stdiosync)
+    stdiosync(-1);
+  _exit(status);
+}
+
+int
+exec(char *path, char **argv)
+{
+  if(stdiosync)
+    stdiosync(-1);
+  return _exec(path, argv);
+}
+
+int
+close(int fd)
+{
+  if(stdiosync)
+    stdiosync(fd);
+  return _close(fd);
+}
+
+static void
+threadmain(void *a)
+{
+  uint64 *s = a;
+
+  ((void (*)(void*))s[0])((void*)s[1]);
+  exit(0);
+}
+
+// the new thread starts in threadmain(), which finds fn and
+// arg at the top of its stack, so that it can exit when fn
+// returns.
+int
+clone(void (*fn)(void*), void *arg, void *stack)
+{
+  uint64 *s = (uint64*)stack - 2;
+
+  s[0] = (uint64)fn;
+  s[1] = (uint64)arg;
+  return _clone(threadmain, s, s);
+}
+
 char*
 strcpy(char *s, const char *t)
 {
@@ -32,14 +96,38 @@ strlen(const char *s)
   return n;
 }
 
+// memset, memmove and memcmp are copies of the word-at-a-time
+// versions in kernel/string.c; change both together. like the
+// kernel's, memcmp compares bytes as unsigned chars.
+
+#define WALIGNED(p) (((uint64)(p) & 7) == 0)
+
 void*
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uchar *d = (uchar *) dst;
+  uint64 *wd, w;
+
+  while(n > 0 && !WALIGNED(d)){
+    *d++ = c;
+    n--;
+  }
+  if(n >= 8){
+    w = (uchar) c;
+    w |= w << 8;
+    w |= w << 16;
+    w |= w << 32;
+    wd = (uint64 *) d;
+    for(; n >= 64; n -= 64, wd += 8){
+      wd[0] = w; wd[1] = w; wd[2] = w; wd[3] = w;
+      wd[4] = w; wd[5] = w; wd[6] = w; wd[7] = w;
+    }
+    for(; n >= 8; n -= 8)
+      *wd++ = w;
+    d = (uchar *) wd;
   }
+  while(n-- > 0)
+    *d++ = c;
   return dst;
 }
 
@@ -96,36 +184,86 @@ atoi(const char *s)
 }
 
 void*
-memmove(void *vdst, const void *vsrc, int n)
+memmove(void *dst, const void *src, int n)
 {
-  char *dst;
-  const char *src;
+  const char *s;
+  char *d;
+  const uint64 *ws;
+  uint64 *wd;
+  int words;
 
-  dst = vdst;
-  src = vsrc;
-  if (src > dst) {
+  s = src;
+  d = dst;
+  words = ((uint64)s & 7) == ((uint64)d & 7);
+  if(s < d && s + n > d){
+    s += n;
+    d += n;
+    if(words){
+      while(n > 0 && !WALIGNED(d)){
+        *--d = *--s;
+        n--;
+      }
+      ws = (const uint64 *) s;
+      wd = (uint64 *) d;
+      for(; n >= 64; n -= 64){
+        ws -= 8, wd -= 8;
+        wd[7] = ws[7]; wd[6] = ws[6]; wd[5] = ws[5]; wd[4] = ws[4];
+        wd[3] = ws[3]; wd[2] = ws[2]; wd[1] = ws[1]; wd[0] = ws[0];
+      }
+      for(; n >= 8; n -= 8)
+        *--wd = *--ws;
+      s = (const char *) ws;
+      d = (char *) wd;
+    }
     while(n-- > 0)
-      *dst++ = *src++;
+      *--d = *--s;
   } else {
-    dst += n;
-    src += n;
+    if(words){
+      while(n > 0 && !WALIGNED(d)){
+        *d++ = *s++;
+        n--;
+      }
+      ws = (const uint64 *) s;
+      wd = (uint64 *) d;
+      for(; n >= 64; n -= 64, ws += 8, wd += 8){
+        wd[0] = ws[0]; wd[1] = ws[1]; wd[2] = ws[2]; wd[3] = ws[3];
+        wd[4] = ws[4]; wd[5] = ws[5]; wd[6] = ws[6]; wd[7] = ws[7];
+      }
+      for(; n >= 8; n -= 8)
+        *wd++ = *ws++;
+      s = (const char *) ws;
+      d = (char *) wd;
+    }
     while(n-- > 0)
-      *--dst = *--src;
+      *d++ = *s++;
   }
-  return vdst;
+
+  return dst;
 }
 
 int
-memcmp(const void *s1, const void *s2, uint n)
+memcmp(const void *v1, const void *v2, uint n)
 {
-  const char *p1 = s1, *p2 = s2;
-  while (n-- > 0) {
-    if (*p1 != *p2) {
-      return *p1 - *p2;
+  const uchar *s1, *s2;
+
+  s1 = v1;
+  s2 = v2;
+  if(((uint64)s1 & 7) == ((uint64)s2 & 7)){
+    while(n > 0 && !WALIGNED(s1)){
+      if(*s1 != *s2)
+        return *s1 - *s2;
+      s1++, s2++, n--;
     }
-    p1++;
-    p2++;
+    // skip equal words; the bytes below find the difference.
+    while(n >= 8 && *(uint64 *)s1 == *(uint64 *)s2)
+      s1 += 8, s2 += 8, n -= 8;
+  }
+  while(n-- > 0){
+    if(*s1 != *s2)
+      return *s1 - *s2;
+    s1++, s2++;
   }
+
   return 0;
 }
 
@@ -134,3 +272,68 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// The following read the pages the kernel maps at VDSO
+// and VDSOPROC, and need no system call.
+
+int
+vgetpid(void)
+{
+  return ((volatile struct vdsoproc*)VDSOPROC)->pid;
+}
+
+// CPU this process was running on when last scheduled.
+int
+vgetcpu(void)
+{
+  return ((volatile struct vdsoproc*)VDSOPROC)->cpu;
+}
+
+// clock ticks since boot, like uptime().
+int
+vuptime(void)
+{
+  return ((volatile struct vdso*)VDSO)->ticks;
+}
+
+// raw time CSR; vtimebase() of these per second.
+uint64
+rdtime(void)
+{
+  uint64 x;
+  asm volatile("rdtime %0" : "=r" (x));
+  return x;
+}
+
+// raw cycle CSR.
+uint64
+rdcycle(void)
+{
+  uint64 x;
+  asm volatile("rdcycle %0" : "=r" (x));
+  return x;
+}
+
+// raw instret CSR.
+uint64
+rdinstret(void)
+{
+  uint64 x;
+  asm volatile("rdinstret %0" : "=r" (x));
+  return x;
+}
+
+uint64
+vtimebase(void)
+{
+  return ((volatile struct vdso*)VDSO)->timebase;
+}
+
+// microseconds since boot, from the time CSR.
+uint64
+vuptimeus(void)
+{
+  volatile struct vdso *v = (volatile struct vdso*)VDSO;
+
+  return (rdtime() - v->boottime) * 1000000 / v->timebase;
+}
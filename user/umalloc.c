@@ -3,88 +3,203 @@
 #include "user/user.h"
 #include "kernel/param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator with segregated size classes.
+//
+// Every block starts with a 16-byte header holding its size,
+// so free() knows where to put it. Small blocks, up to
+// MAXSMALL bytes including the header, come in a fixed set
+// of sizes, each with its own free list, so malloc() and
+// free() take constant time. They are carved from arenas
+// grown ARENA bytes at a time with sbrk().
+// Larger blocks get memory of their own from sbrk(). Free
+// large blocks are merged with their free neighbours and
+// reused first-fit; one at the top of the heap is returned
+// to the kernel.
 
-typedef long Align;
+#define MAXSMALL 4096
+#define ARENA    (64*1024)
 
-union header {
-  struct {
-    union header *ptr;
-    uint size;
-  } s;
-  Align x;
+typedef struct block {
+  uint64 size;          // bytes, including this header
+  struct block *next;   // next free block; unused while allocated
+} Block;
+
+static uint sizes[] = {
+  32, 48, 64, 80, 96, 112, 128, 192, 256, 384, 512,
+  768, 1024, 1536, 2048, 3072, 4096,
 };
+#define NCLASS (sizeof(sizes)/sizeof(sizes[0]))
 
-typedef union header Header;
+static uchar classof[MAXSMALL/16 + 1];  // size/16 -> smallest class that fits
+static Block *bins[NCLASS];
+static Block *large;                    // free large blocks
+static char *arena, *arenaend;          // unused part of the current arena
 
-static Header base;
-static Header *freep;
+static void
+classinit(void)
+{
+  int c = 0;
 
-void
-free(void *ap)
+  for(int i = 0; i <= MAXSMALL/16; i++){
+    while(sizes[c] < i*16)
+      c++;
+    classof[i] = c;
+  }
+}
+
+// Put the rest of the current arena on the free lists,
+// in the largest pieces that fit.
+static void
+retire(void)
 {
-  Header *bp, *p;
-
-  bp = (Header*)ap - 1;
-  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if(bp + bp->s.size == p->s.ptr){
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
-  } else
-    bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
-  } else
-    p->s.ptr = bp;
-  freep = p;
+  Block *b;
+  int c;
+
+  for(c = NCLASS-1; c >= 0; c--){
+    while(arenaend - arena >= sizes[c]){
+      b = (Block*)arena;
+      b->size = sizes[c];
+      b->next = bins[c];
+      bins[c] = b;
+      arena += sizes[c];
+    }
+  }
 }
 
-static Header*
-morecore(uint nu)
+// Carve a block of class c from the arena.
+static Block*
+carve(int c)
 {
+  Block *b;
   char *p;
-  Header *hp;
+  int n;
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
-  if(p == (char*)-1)
+  if(arenaend - arena < sizes[c]){
+    // when memory is short, try for just enough.
+    n = ARENA;
+    if((p = sbrk(n)) == (char*)-1){
+      n = MAXSMALL;
+      if((p = sbrk(n)) == (char*)-1)
+        return 0;
+    }
+    if(p != arenaend){
+      retire();
+      arena = p;
+    }
+    arenaend = p + n;
+  }
+  b = (Block*)arena;
+  b->size = sizes[c];
+  arena += sizes[c];
+  return b;
+}
+
+static Block*
+largealloc(uint64 size)
+{
+  Block *b, **pp;
+  char *p;
+
+  for(pp = &large; (b = *pp) != 0; pp = &b->next){
+    if(b->size < size)
+      continue;
+    if(b->size - size > MAXSMALL){
+      // split, keeping the front on the free list.
+      b->size -= size;
+      b = (Block*)((char*)b + b->size);
+      b->size = size;
+    } else {
+      *pp = b->next;
+    }
+    return b;
+  }
+  if(size > 0x7fffffff || (p = sbrk(size)) == (char*)-1)
     return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
-  return freep;
+  b = (Block*)p;
+  b->size = size;
+  return b;
 }
 
-void*
-malloc(uint nbytes)
+// Free a large block. The free list is kept in address
+// order so that neighbouring free blocks can be merged, and
+// a free block at the top of the heap is given back to the
+// kernel, if it will take it: not while there are threads.
+static void
+largefree(Block *b)
 {
-  Header *p, *prevp;
-  uint nunits;
+  Block *prev, *next;
+
+  prev = 0;
+  for(next = large; next != 0 && next < b; next = next->next)
+    prev = next;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
+  if(next != 0 && (char*)b + b->size == (char*)next){
+    b->size += next->size;
+    next = next->next;
   }
-  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){
-      if(p->s.size == nunits)
-        prevp->s.ptr = p->s.ptr;
-      else {
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
-      }
-      freep = prevp;
-      return (void*)(p + 1);
+  b->next = next;
+  if(prev != 0 && (char*)prev + prev->size == (char*)b){
+    prev->size += b->size;
+    prev->next = b->next;
+    b = prev;
+  } else if(prev != 0){
+    prev->next = b;
+  } else {
+    large = b;
+  }
+
+  if(b->next == 0 && (char*)b + b->size == sbrk(0) &&
+     sbrk(-(int)b->size) != (char*)-1){
+    // b is gone; unlink it without touching it.
+    if(prev == b){
+      // b was merged into prev; find prev's predecessor.
+      for(prev = 0, next = large; next != b; next = next->next)
+        prev = next;
     }
-    if(p == freep)
-      if((p = morecore(nunits)) == 0)
-        return 0;
+    if(prev != 0)
+      prev->next = 0;
+    else
+      large = 0;
   }
 }
+
+void
+free(void *ap)
+{
+  Block *b;
+  int c;
+
+  if(ap == 0)
+    return;
+  b = (Block*)ap - 1;
+  if(b->size > MAXSMALL){
+    largefree(b);
+    return;
+  }
+  c = classof[b->size/16];
+  b->next = bins[c];
+  bins[c] = b;
+}
+
+void*
+malloc(uint nbytes)
+{
+  uint64 size;
+  Block *b;
+  int c;
+
+  if(classof[MAXSMALL/16] == 0)
+    classinit();
+  size = ((uint64)nbytes + sizeof(Block) + 15) & ~15L;
+  if(size > MAXSMALL){
+    if((b = largealloc(size)) == 0)
+      return 0;
+    return (void*)(b + 1);
+  }
+  c = classof[size/16];
+  if((b = bins[c]) != 0)
+    bins[c] = b->next;
+  else if((b = carve(c)) == 0)
+    return 0;
+  return (void*)(b + 1);
+}
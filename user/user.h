@@ -1,5 +1,13 @@
 struct stat;
 struct rtcdate;
+struct pollfd;
+struct uring;
+struct profsample;
+struct sysstat;
+struct traceevent;
+struct perfstat;
+struct dent;
+struct spawnact;
 
 // system calls
 int fork(void);
@@ -23,6 +31,49 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int splice(int, int, int);
+int tee(int, int, int);
+int sendfile(int, int, int);
+int poll(struct pollfd*, int, int);
+int fcntl(int, int, int);
+int uring_enter(struct uring*, int);
+int profctl(int);
+int profread(struct profsample*, int);
+int sysstat(int, struct sysstat*);
+int tracectl(uint);
+int traceread(struct traceevent*, int);
+int perfstat(struct perfstat*);
+int getdents(int, struct dent*, int);
+int fstatat(int, const char*, struct stat*);
+// the child shares the caller's memory, stdio buffers included,
+// and must not return from the calling function; it should only
+// set up file descriptors and exec() or exit().
+int vfork(void) __attribute__((returns_twice));
+int spawn(char*, char**, struct spawnact*, int);
+// run fn(arg) in a thread sharing the caller's memory, files
+// and current directory, on the stack whose top is stack. the
+// thread exits when fn returns; wait() for it like a child.
+// while there are other threads, exec() and shrinking
+// sbrk() fail. nothing in ulib locks: malloc()/free() share
+// umalloc.c's free list, and printf() shares the per-fd
+// output buffers, so only one thread may use each at a time.
+int clone(void (*)(void*), void*, void*);
+
+// the system calls behind fork, exit, exec and close,
+// which ulib.c wraps to flush stdio buffers first.
+int _fork(void);
+int _exit(int) __attribute__((noreturn));
+int _exec(char*, char**);
+int _close(int);
+int _clone(void (*)(void*), void*, void*);
+
+// stdio buffering modes, for setbufmode(). printf output
+// sits in a per-fd buffer until it is written out, so a
+// write() to the same fd meanwhile comes out ahead of it;
+// fflush() the fd first to keep the two in order.
+#define STDIO_UNBUF 1  // write out at the end of each printf
+#define STDIO_LINE  2  // write out at each newline
+#define STDIO_FULL  3  // write out when the buffer fills
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -32,6 +83,8 @@ char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
 void fprintf(int, const char*, ...);
 void printf(const char*, ...);
+int fflush(int);
+int setbufmode(int, int);
 char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
@@ -40,3 +93,15 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+int vgetpid(void);
+int vgetcpu(void);
+int vuptime(void);
+uint64 rdtime(void);
+uint64 rdcycle(void);
+uint64 rdinstret(void);
+uint64 vtimebase(void);
+uint64 vuptimeus(void);
+
+// ksym.c, linked into prof and ktrace
+void loadksyms(char*);
+char* ksym(uint64, uint64*);
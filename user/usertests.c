@@ -4,6 +4,13 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/poll.h"
+#include "kernel/uring.h"
+#include "kernel/prof.h"
+#include "kernel/sysstat.h"
+#include "kernel/trace.h"
+#include "kernel/perf.h"
+#include "kernel/spawn.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -735,6 +742,1171 @@ pipe1(char *s)
   }
 }
 
+// large pipe writes and reads of odd sizes, so that copies
+// wrap around and cross the pipe's buffer pages.
+void
+pipe2(char *s)
+{
+  int fds[2], pid, xstatus;
+  int seq, i, n, cc, total;
+  enum { N=7 };
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  seq = 0;
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < N; n++){
+      for(i = 0; i < sizeof(buf); i++)
+        buf[i] = seq++;
+      if(write(fds[1], buf, sizeof(buf)) != sizeof(buf)){
+        printf("%s: pipe2 oops 1\n", s);
+        exit(1);
+      }
+    }
+    exit(0);
+  } else if(pid > 0){
+    close(fds[1]);
+    total = 0;
+    cc = 1;
+    while((n = read(fds[0], buf, cc)) > 0){
+      for(i = 0; i < n; i++){
+        if((buf[i] & 0xff) != (seq++ & 0xff)){
+          printf("%s: pipe2 oops 2\n", s);
+          exit(1);
+        }
+      }
+      total += n;
+      cc = cc * 3 + 1;
+      if(cc > sizeof(buf))
+        cc = 1;
+    }
+    if(total != N * sizeof(buf)){
+      printf("%s: pipe2 oops 3 total %d\n", s, total);
+      exit(1);
+    }
+    close(fds[0]);
+    wait(&xstatus);
+    exit(xstatus);
+  } else {
+    printf("%s: fork() failed\n", s);
+    exit(1);
+  }
+}
+
+// move a file through two pipes with sendfile(), tee()
+// and splice(), and check that both copies arrive intact.
+void
+splicetest(char *s)
+{
+  enum { SZ = 3*BSIZE + 77 };
+  int fd, p1[2], p2[2], i, n, total;
+
+  fd = open("splicefile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create splicefile failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = i * 7;
+  if(write(fd, buf, SZ) != SZ){
+    printf("%s: write splicefile failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(pipe(p1) < 0 || pipe(p2) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  fd = open("splicefile", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open splicefile failed\n", s);
+    exit(1);
+  }
+  for(total = 0; total < SZ; total += n){
+    if((n = sendfile(p1[1], fd, SZ - total)) <= 0){
+      printf("%s: sendfile returned %d\n", s, n);
+      exit(1);
+    }
+  }
+  close(fd);
+  close(p1[1]);
+
+  for(total = 0; total < SZ; total += n){
+    if((n = tee(p1[0], p2[1], SZ - total)) <= 0){
+      printf("%s: tee returned %d\n", s, n);
+      exit(1);
+    }
+  }
+  close(p2[1]);
+
+  // tee() left the data in p1; splice() it back into a file.
+  unlink("splicefile");
+  fd = open("splicefile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create splicefile failed\n", s);
+    exit(1);
+  }
+  for(total = 0; (n = splice(p1[0], fd, SZ)) > 0; total += n)
+    ;
+  if(n < 0 || total != SZ){
+    printf("%s: splice moved %d of %d\n", s, total, SZ);
+    exit(1);
+  }
+  close(fd);
+  close(p1[0]);
+
+  fd = open("splicefile", O_RDONLY);
+  memset(buf, 0, SZ);
+  if(read(fd, buf, SZ) != SZ){
+    printf("%s: short splicefile\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("splicefile");
+  for(i = 0; i < SZ; i++){
+    if(buf[i] != (char)(i * 7)){
+      printf("%s: splicefile wrong byte %d\n", s, i);
+      exit(1);
+    }
+  }
+
+  memset(buf, 0, SZ);
+  for(total = 0; (n = read(p2[0], buf + total, SZ - total)) > 0; total += n)
+    ;
+  close(p2[0]);
+  if(total != SZ){
+    printf("%s: tee copy has %d of %d\n", s, total, SZ);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++){
+    if(buf[i] != (char)(i * 7)){
+      printf("%s: tee copy wrong byte %d\n", s, i);
+      exit(1);
+    }
+  }
+}
+
+// check that pipe fd holds exactly n bytes of the pattern
+// splicepipetest wrote, then close it.
+void
+splicecheck(char *s, char *what, int fd, int n)
+{
+  int i, m, total;
+
+  memset(buf, 0, n);
+  for(total = 0; total < n && (m = read(fd, buf + total, n - total)) > 0; total += m)
+    ;
+  close(fd);
+  if(total != n){
+    printf("%s: %s has %d of %d\n", s, what, total, n);
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    if(buf[i] != (char)(i * 13 + i / PGSIZE)){
+      printf("%s: %s wrong byte %d\n", s, what, i);
+      exit(1);
+    }
+  }
+}
+
+// tee() and splice() whole pages from pipe to pipe, which
+// hands pages over rather than copying them.
+void
+splicepipetest(char *s)
+{
+  enum { SZ = 3*PGSIZE };
+  int p1[2], p2[2], p3[2], i, n, total;
+
+  if(pipe(p1) < 0 || pipe(p2) < 0 || pipe(p3) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = i * 13 + i / PGSIZE;
+  if(write(p1[1], buf, SZ) != SZ){
+    printf("%s: write to pipe failed\n", s);
+    exit(1);
+  }
+  close(p1[1]);
+
+  for(total = 0; total < SZ; total += n){
+    if((n = tee(p1[0], p2[1], SZ - total)) <= 0){
+      printf("%s: tee returned %d\n", s, n);
+      exit(1);
+    }
+  }
+  close(p2[1]);
+
+  // tee() left everything in p1 for splice() to take.
+  for(total = 0; total < SZ; total += n){
+    if((n = splice(p1[0], p3[1], SZ - total)) <= 0){
+      printf("%s: splice returned %d\n", s, n);
+      exit(1);
+    }
+  }
+  close(p3[1]);
+  if(read(p1[0], buf, 1) != 0){
+    printf("%s: splice left bytes in the source\n", s);
+    exit(1);
+  }
+  close(p1[0]);
+
+  splicecheck(s, "tee copy", p2[0], SZ);
+  splicecheck(s, "splice copy", p3[0], SZ);
+}
+
+// poll() on pipes, with and without a timeout,
+// and O_NONBLOCK reads and writes.
+void
+polltest(char *s)
+{
+  int p1[2], p2[2], pid, n, xstatus;
+  struct pollfd fds[2];
+  char c;
+
+  if(pipe(p1) < 0 || pipe(p2) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+
+  fds[0].fd = p1[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = p2[0];
+  fds[1].events = POLLIN;
+  if((n = poll(fds, 2, 0)) != 0){
+    printf("%s: poll on empty pipes returned %d\n", s, n);
+    exit(1);
+  }
+  if((n = poll(fds, 2, 2)) != 0){
+    printf("%s: poll timeout returned %d\n", s, n);
+    exit(1);
+  }
+
+  fcntl(p1[0], F_SETFL, O_NONBLOCK);
+  if(fcntl(p1[0], F_GETFL, 0) != O_NONBLOCK){
+    printf("%s: F_GETFL lost O_NONBLOCK\n", s);
+    exit(1);
+  }
+  if(read(p1[0], &c, 1) != -1){
+    printf("%s: nonblocking read of empty pipe succeeded\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(3);
+    write(p2[1], "x", 1);
+    exit(0);
+  }
+
+  if((n = poll(fds, 2, -1)) != 1 || fds[0].revents != 0 ||
+     fds[1].revents != POLLIN){
+    printf("%s: poll returned %d %d %d\n", s, n, fds[0].revents, fds[1].revents);
+    exit(1);
+  }
+  if(read(p2[0], &c, 1) != 1 || c != 'x'){
+    printf("%s: read after poll failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+
+  // fill p1 without blocking, then poll for room.
+  fcntl(p1[1], F_SETFL, O_NONBLOCK);
+  while((n = write(p1[1], buf, sizeof(buf))) > 0)
+    ;
+  fds[0].fd = p1[1];
+  fds[0].events = POLLOUT;
+  if(poll(fds, 1, 0) != 0){
+    printf("%s: full pipe polled writable\n", s);
+    exit(1);
+  }
+  if(read(p1[0], buf, 1) != 1 || poll(fds, 1, 0) != 1 || fds[0].revents != POLLOUT){
+    printf("%s: drained pipe not writable\n", s);
+    exit(1);
+  }
+
+  // closing the write end reports POLLHUP.
+  close(p2[1]);
+  fds[0].fd = p2[0];
+  fds[0].events = POLLIN;
+  if(poll(fds, 1, 0) != 1 || (fds[0].revents & POLLHUP) == 0){
+    printf("%s: no POLLHUP on closed pipe\n", s);
+    exit(1);
+  }
+
+  close(p1[0]);
+  close(p1[1]);
+  close(p2[0]);
+}
+
+static void
+uringpush(struct uring *r, int op, int fd, void *addr, int len, int flags)
+{
+  struct uring_sqe *e = &r->sq[r->sq_tail % URING_ENTRIES];
+
+  memset(e, 0, sizeof(*e));
+  e->op = op;
+  e->flags = flags;
+  e->fd = fd;
+  e->addr = (uint64)addr;
+  e->len = len;
+  e->user_data = r->sq_tail;
+  r->sq_tail++;
+}
+
+// batched writes, reads, fstat and close through uring_enter().
+void
+uringtest(char *s)
+{
+  static struct uring r;
+  struct uring_cqe *c;
+  struct stat st;
+  int fd, i, n;
+  char rb[40];
+
+  memset(&r, 0, sizeof(r));
+  fd = open("uringfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create uringfile failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 4; i++)
+    uringpush(&r, URING_WRITE, fd, "0123456789", 10, 0);
+  uringpush(&r, URING_FSTAT, fd, &st, 0, 0);
+  uringpush(&r, URING_CLOSE, fd, 0, 0, 0);
+  // a failed linked op cancels the one after it.
+  uringpush(&r, URING_READ, fd, rb, 1, URING_F_LINK);
+  uringpush(&r, URING_NOP, 0, 0, 0, 0);
+  uringpush(&r, URING_NOP, 0, 0, 0, 0);
+  if((n = uring_enter(&r, 100)) != 9 || r.sq_head != 9 || r.cq_tail != 9){
+    printf("%s: uring_enter returned %d\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i < 9; i++){
+    c = &r.cq[r.cq_head++ % URING_ENTRIES];
+    if(c->user_data != i ||
+       c->res != (i < 4 ? 10 : i == 6 || i == 7 ? -1 : 0)){
+      printf("%s: cqe %d res %d\n", s, i, c->res);
+      exit(1);
+    }
+  }
+  if(st.size != 40){
+    printf("%s: fstat size %d\n", s, st.size);
+    exit(1);
+  }
+
+  fd = open("uringfile", O_RDONLY);
+  for(i = 0; i < 4; i++)
+    uringpush(&r, URING_READ, fd, rb + 10*i, 10, 0);
+  uringpush(&r, URING_CLOSE, fd, 0, 0, 0);
+  if(uring_enter(&r, 5) != 5){
+    printf("%s: uring_enter read failed\n", s);
+    exit(1);
+  }
+  r.cq_head = r.cq_tail;
+  unlink("uringfile");
+  for(i = 0; i < 40; i++){
+    if(rb[i] != '0' + i % 10){
+      printf("%s: wrong byte %d\n", s, i);
+      exit(1);
+    }
+  }
+  if(close(fd) != -1){
+    printf("%s: URING_CLOSE left fd open\n", s);
+    exit(1);
+  }
+
+  // a ring whose cq runs off the top of memory after two
+  // entries: the completions that fit are still published.
+  uint64 top = (uint64) sbrk(0);
+  if(top % PGSIZE)
+    sbrk(PGSIZE - top % PGSIZE);
+  top = (uint64) sbrk(0);
+  struct uring *rp = (struct uring *)(top - (uint64)&((struct uring*)0)->cq[2]);
+  memset(rp, 0, top - (uint64)rp);
+  for(i = 0; i < 4; i++)
+    uringpush(rp, URING_NOP, 0, 0, 0, 0);
+  if((n = uring_enter(rp, 4)) != 2 || rp->cq_tail != 2 || rp->sq_head != 3){
+    printf("%s: uring_enter on a short ring returned %d\n", s, n);
+    exit(1);
+  }
+}
+
+// the vdso pages agree with the system calls they replace.
+void
+vdsotest(char *s)
+{
+  int pid, xstatus, t;
+  uint64 t0;
+
+  if(vgetpid() != getpid()){
+    printf("%s: vgetpid %d getpid %d\n", s, vgetpid(), getpid());
+    exit(1);
+  }
+  t = uptime();
+  if(vuptime() < t || vuptime() > t + 1){
+    printf("%s: vuptime %d uptime %d\n", s, vuptime(), t);
+    exit(1);
+  }
+  t0 = rdtime();
+  sleep(2);
+  if(rdtime() - t0 < vtimebase() / 20){
+    printf("%s: time CSR did not advance\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(vgetpid() == getpid() ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw the wrong vgetpid\n", s);
+    exit(1);
+  }
+
+  // the pages are read-only.
+  pid = fork();
+  if(pid == 0){
+    *(int*)VDSOPROC = 0;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: wrote the vdso page\n", s);
+    exit(1);
+  }
+}
+
+// the profiler samples a process spinning in user space.
+void
+proftest(char *s)
+{
+  static struct profsample buf[16];
+  int i, n, mine, t;
+
+  profctl(1);
+  t = vuptime();
+  while(vuptime() < t + 3)
+    ;
+  profctl(0);
+
+  mine = 0;
+  while((n = profread(buf, sizeof(buf)/sizeof(buf[0]))) > 0){
+    for(i = 0; i < n; i++){
+      if(buf[i].depth < 1 || buf[i].depth > PROFDEPTH){
+        printf("%s: bad sample depth %d\n", s, buf[i].depth);
+        exit(1);
+      }
+      if(buf[i].pid == getpid() && buf[i].user)
+        mine++;
+    }
+  }
+  if(n < 0){
+    printf("%s: profread failed\n", s);
+    exit(1);
+  }
+  if(mine == 0){
+    printf("%s: no samples of this process\n", s);
+    exit(1);
+  }
+}
+
+// sysstat() counts system calls per process and system-wide.
+void
+sysstattest(char *s)
+{
+  static struct sysstat st0, st1;
+  uint64 h;
+  int i, b;
+
+  if(sysstat(0, &st0) < 0){
+    printf("%s: sysstat failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 100; i++)
+    getpid();
+  if(sysstat(0, &st1) < 0){
+    printf("%s: sysstat failed\n", s);
+    exit(1);
+  }
+  if(st1.count[SYS_getpid] - st0.count[SYS_getpid] < 100){
+    printf("%s: missed getpid calls\n", s);
+    exit(1);
+  }
+  h = 0;
+  for(b = 0; b < NSYSHIST; b++)
+    h += st1.hist[SYS_getpid][b];
+  if(h < st1.count[SYS_getpid]){
+    printf("%s: histogram does not add up\n", s);
+    exit(1);
+  }
+
+  if(sysstat(getpid(), &st1) < 0 || st1.count[SYS_getpid] < 100){
+    printf("%s: bad per-process count\n", s);
+    exit(1);
+  }
+  // there are no per-process histograms.
+  for(b = 0; b < NSYSHIST; b++){
+    if(st1.hist[SYS_getpid][b] != 0){
+      printf("%s: per-process histogram not zero\n", s);
+      exit(1);
+    }
+  }
+  if(sysstat(-1, &st1) >= 0){
+    printf("%s: sysstat of no process succeeded\n", s);
+    exit(1);
+  }
+}
+
+// sleeping shows up in the trace as a sleep and a switch.
+void
+tracetest(char *s)
+{
+  static struct traceevent buf[16];
+  int i, n, pid, sleeps, switches;
+
+  pid = getpid();
+  tracectl((1 << TR_SLEEP) | (1 << TR_SWITCH));
+  sleep(1);
+  tracectl(0);
+
+  sleeps = switches = 0;
+  while((n = traceread(buf, sizeof(buf)/sizeof(buf[0]))) > 0){
+    for(i = 0; i < n; i++){
+      if(buf[i].pid != pid)
+        continue;
+      if(buf[i].type == TR_SLEEP)
+        sleeps++;
+      else if(buf[i].type == TR_SWITCH)
+        switches++;
+      else {
+        printf("%s: disabled event %d recorded\n", s, buf[i].type);
+        exit(1);
+      }
+    }
+  }
+  if(sleeps == 0 || switches == 0){
+    printf("%s: %d sleeps, %d switches\n", s, sleeps, switches);
+    exit(1);
+  }
+}
+
+// perfstat() counts the caller's cycles and instructions,
+// and those of waited-for children.
+void
+perftest(char *s)
+{
+  struct perfstat p0, p1;
+  volatile int i;
+  uint64 r0;
+  int pid;
+
+  r0 = rdinstret();
+  perfstat(&p0);
+  for(i = 0; i < 100000; i++)
+    ;
+  perfstat(&p1);
+  if(rdinstret() - r0 < 100000){
+    printf("%s: instret did not advance\n", s);
+    exit(1);
+  }
+  if(p1.cycles <= p0.cycles || p1.instret - p0.instret < 100000){
+    printf("%s: own counts did not advance\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < 100000; i++)
+      ;
+    exit(0);
+  }
+  wait(0);
+  perfstat(&p0);
+  if(p0.cinstret - p1.cinstret < 100000){
+    printf("%s: child's counts not added\n", s);
+    exit(1);
+  }
+}
+
+// printf to a pipe is buffered: nothing is written until
+// fork() flushes the buffer, in one write, so that the new
+// child does not write it out again, and exit() then finds
+// it empty.
+void
+stdiotest(char *s)
+{
+  static struct sysstat st0, st1;
+  static char buf[512];
+  int fds[2], pid, i, n, tot, xstatus;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    sysstat(getpid(), &st0);
+    for(i = 0; i < 100; i++)
+      fprintf(fds[1], "%d\n", i % 10);
+    sysstat(getpid(), &st1);
+    if(st1.count[SYS_write] - st0.count[SYS_write] > 1)
+      exit(1);
+    fprintf(fds[1], "x");
+    if(fork() == 0)
+      exit(0);
+    wait(0);
+    sysstat(getpid(), &st1);
+    if(st1.count[SYS_write] - st0.count[SYS_write] != 1)
+      exit(2);
+    exit(0);
+  }
+  close(fds[1]);
+  tot = 0;
+  while((n = read(fds[0], buf + tot, sizeof(buf) - tot)) > 0)
+    tot += n;
+  close(fds[0]);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: printf was %s\n", s,
+           xstatus == 1 ? "not buffered" : "not flushed in one write at fork");
+    exit(1);
+  }
+  if(tot != 201 || buf[0] != '0' || buf[199] != '\n' || buf[200] != 'x'){
+    printf("%s: read %d bytes of output, expected 201\n", s, tot);
+    exit(1);
+  }
+}
+
+// freed small blocks are reused, and a freed large block
+// at the top of the heap goes back to the kernel.
+void
+malloctest(char *s)
+{
+  char *p, *q, *top;
+
+  p = malloc(100);
+  free(p);
+  if((q = malloc(100)) != p){
+    printf("%s: freed block not reused\n", s);
+    exit(1);
+  }
+  free(q);
+
+  if((p = malloc(1024*1024)) == 0){
+    printf("%s: malloc failed\n", s);
+    exit(1);
+  }
+  memset(p, 1, 1024*1024);
+  top = sbrk(0);
+  free(p);
+  if(sbrk(0) > top - 1024*1024){
+    printf("%s: memory not returned\n", s);
+    exit(1);
+  }
+}
+
+// getdents() lists a directory with each entry's type and
+// size, and fstatat() looks names up relative to a directory.
+void
+getdentstest(char *s)
+{
+  struct dent de[8];
+  struct stat st;
+  int fd, fd2, i, n, seen;
+
+  if(mkdir("gdd") < 0 || mkdir("gdd/sub") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  if((fd = open("gdd/file", O_CREATE|O_WRONLY)) < 0 || write(fd, "hello", 5) != 5){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if((fd = open("gdd", O_RDONLY)) < 0){
+    printf("%s: open gdd failed\n", s);
+    exit(1);
+  }
+  seen = 0;
+  while((n = getdents(fd, de, 3)) > 0){
+    for(i = 0; i < n; i++){
+      if(strcmp(de[i].name, "file") == 0 && de[i].type == T_FILE && de[i].size == 5)
+        seen |= 1;
+      else if(strcmp(de[i].name, "sub") == 0 && de[i].type == T_DIR)
+        seen |= 2;
+      else if(strcmp(de[i].name, ".") != 0 && strcmp(de[i].name, "..") != 0){
+        printf("%s: unexpected entry %s\n", s, de[i].name);
+        exit(1);
+      }
+    }
+  }
+  if(n < 0 || seen != 3){
+    printf("%s: getdents returned %d, seen %d\n", s, n, seen);
+    exit(1);
+  }
+
+  // a buffer that ends at the top of memory after two entries:
+  // getdents() returns those two, and the rest come next time.
+  uint64 top = (uint64) sbrk(0);
+  if(top % PGSIZE)
+    sbrk(PGSIZE - top % PGSIZE);
+  top = (uint64) sbrk(0);
+  struct dent *end = (struct dent *) top - 2;
+  if((fd2 = open("gdd", O_RDONLY)) < 0){
+    printf("%s: open gdd failed\n", s);
+    exit(1);
+  }
+  if((n = getdents(fd2, (struct dent *) top, 4)) != -1){
+    printf("%s: getdents into no buffer returned %d\n", s, n);
+    exit(1);
+  }
+  if((n = getdents(fd2, end, 4)) != 2){
+    printf("%s: getdents into a short buffer returned %d\n", s, n);
+    exit(1);
+  }
+  if((n = getdents(fd2, de, 8)) != 2){
+    printf("%s: getdents after a short buffer returned %d\n", s, n);
+    exit(1);
+  }
+  close(fd2);
+
+  if(fstatat(fd, "file", &st) < 0 || st.type != T_FILE || st.size != 5){
+    printf("%s: fstatat file failed\n", s);
+    exit(1);
+  }
+  if(fstatat(fd, "sub", &st) < 0 || st.type != T_DIR){
+    printf("%s: fstatat sub failed\n", s);
+    exit(1);
+  }
+  if(fstatat(fd, "nonexistent", &st) >= 0){
+    printf("%s: fstatat of a missing name succeeded\n", s);
+    exit(1);
+  }
+  if(fstatat(AT_FDCWD, "gdd/file", &st) < 0 || st.size != 5){
+    printf("%s: fstatat AT_FDCWD failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(unlink("gdd/file") < 0 || unlink("gdd/sub") < 0 || unlink("gdd") < 0){
+    printf("%s: unlink failed\n", s);
+    exit(1);
+  }
+}
+
+// a vfork() child runs in its parent's memory, which cannot
+// grow meanwhile, and the parent waits for it to exit or exec.
+int vforkshared;
+
+void
+vforktest(char *s)
+{
+  char *echoargv[] = { "echo", "OK", 0 };
+  char buf[3];
+  int fd, pid, xstatus;
+
+  vforkshared = 0;
+  pid = vfork();
+  if(pid < 0){
+    printf("%s: vfork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    vforkshared = 1;
+    if(sbrk(4096) != (char*)-1)
+      vforkshared = 2;
+    _exit(7);
+  }
+  if(vforkshared != 1){
+    printf("%s: child's write seen as %d\n", s, vforkshared);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 7){
+    printf("%s: wait failed\n", s);
+    exit(1);
+  }
+
+  unlink("vfork-ok");
+  pid = vfork();
+  if(pid < 0){
+    printf("%s: vfork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    if(open("vfork-ok", O_CREATE|O_WRONLY) != 1)
+      _exit(1);
+    exec("echo", echoargv);
+    _exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: exec in child failed\n", s);
+    exit(1);
+  }
+  if((fd = open("vfork-ok", O_RDONLY)) < 0 || read(fd, buf, 2) != 2 ||
+     buf[0] != 'O' || buf[1] != 'K'){
+    printf("%s: wrong output from child\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("vfork-ok");
+}
+
+// spawn() starts a program with file actions applied to the
+// child's copy of our open files.
+void
+spawntest(char *s)
+{
+  char *echoargv[] = { "echo", "OK", 0 };
+  struct spawnact acts[3];
+  char buf[4];
+  int fd, pid, xstatus, p[2], n;
+
+  if(spawn("nonexistent", echoargv, 0, 0) >= 0){
+    printf("%s: spawn of a missing file succeeded\n", s);
+    exit(1);
+  }
+
+  unlink("spawn-ok");
+  acts[0].op = SPAWN_OPEN;
+  acts[0].fd = 1;
+  acts[0].mode = O_CREATE|O_WRONLY;
+  acts[0].path = (uint64)"spawn-ok";
+  if((pid = spawn("echo", echoargv, acts, 1)) < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: wait failed\n", s);
+    exit(1);
+  }
+  if((fd = open("spawn-ok", O_RDONLY)) < 0 || read(fd, buf, 2) != 2 ||
+     buf[0] != 'O' || buf[1] != 'K'){
+    printf("%s: wrong output from spawned echo\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("spawn-ok");
+
+  if(pipe(p) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  acts[0].op = SPAWN_DUP2;
+  acts[0].fd = 1;
+  acts[0].from = p[1];
+  acts[1].op = SPAWN_CLOSE;
+  acts[1].fd = p[0];
+  acts[2].op = SPAWN_CLOSE;
+  acts[2].fd = p[1];
+  if((pid = spawn("echo", echoargv, acts, 3)) < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  close(p[1]);
+  n = 0;
+  while(n < sizeof(buf) && (xstatus = read(p[0], buf + n, sizeof(buf) - n)) > 0)
+    n += xstatus;
+  close(p[0]);
+  if(n != 3 || buf[0] != 'O' || buf[1] != 'K' || buf[2] != '\n'){
+    printf("%s: wrong output through pipe\n", s);
+    exit(1);
+  }
+  wait(0);
+}
+
+// sh runs a redirected command in a vfork() child, which
+// must leave the shell intact when it execs, or fails to.
+void
+shvforktest(char *s)
+{
+  char *argv[] = { "sh", 0 };
+  char *script = "echo hi > sh-out\nnonexistent > sh-x\necho bye > sh-out\n";
+  char *msg = "exec nonexistent failed";
+  struct spawnact acts[2];
+  char buf[256];
+  int fd, i, n, xstatus;
+
+  unlink("sh-out");
+  unlink("sh-x");
+  unlink("sh-err");
+  if((fd = open("sh-in", O_CREATE|O_WRONLY)) < 0 ||
+     write(fd, script, strlen(script)) != strlen(script)){
+    printf("%s: cannot write script\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  acts[0].op = SPAWN_OPEN;
+  acts[0].fd = 0;
+  acts[0].mode = O_RDONLY;
+  acts[0].path = (uint64)"sh-in";
+  acts[1].op = SPAWN_OPEN;
+  acts[1].fd = 2;
+  acts[1].mode = O_CREATE|O_WRONLY;
+  acts[1].path = (uint64)"sh-err";
+  if(spawn("sh", argv, acts, 2) < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  if(wait(&xstatus) < 0 || xstatus != 0){
+    printf("%s: sh failed\n", s);
+    exit(1);
+  }
+
+  // the shell carried on after both children.
+  if((fd = open("sh-out", O_RDONLY)) < 0 || read(fd, buf, sizeof(buf)) != 4 ||
+     memcmp(buf, "bye\n", 4) != 0){
+    printf("%s: wrong output from echo\n", s);
+    exit(1);
+  }
+  close(fd);
+  if((fd = open("sh-x", O_RDONLY)) < 0){
+    printf("%s: redirection before failed exec not done\n", s);
+    exit(1);
+  }
+  close(fd);
+  if((fd = open("sh-err", O_RDONLY)) < 0 || (n = read(fd, buf, sizeof(buf))) < 0){
+    printf("%s: cannot read sh-err\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(i = 0; i + strlen(msg) <= n; i++)
+    if(memcmp(buf + i, msg, strlen(msg)) == 0)
+      break;
+  if(i + strlen(msg) > n){
+    printf("%s: no exec failure reported\n", s);
+    exit(1);
+  }
+  unlink("sh-in");
+  unlink("sh-out");
+  unlink("sh-x");
+  unlink("sh-err");
+}
+
+// run find with argv and collect what it prints in buf.
+int
+findrun(char *s, char **argv, char *buf, int sz)
+{
+  struct spawnact acts[3];
+  int n, m, p[2], xstatus;
+
+  if(pipe(p) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  acts[0].op = SPAWN_DUP2;
+  acts[0].fd = 1;
+  acts[0].from = p[1];
+  acts[1].op = SPAWN_CLOSE;
+  acts[1].fd = p[0];
+  acts[2].op = SPAWN_CLOSE;
+  acts[2].fd = p[1];
+  if(spawn("find", argv, acts, 3) < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  close(p[1]);
+  n = 0;
+  while(n < sz && (m = read(p[0], buf + n, sz - n)) > 0)
+    n += m;
+  close(p[0]);
+  if(wait(&xstatus) < 0 || xstatus != 0){
+    printf("%s: find failed\n", s);
+    exit(1);
+  }
+  return n;
+}
+
+// find -P with as many workers as it allows, or more, which
+// it clamps, must find every match, and with -o print them
+// in the order a plain find does.
+void
+findtest(char *s)
+{
+  char *argv[] = { "find", "-P", 0, "findd", "x", 0 };
+  char *oargv[] = { "find", "-P", "5", "-o", "findd", "x", 0 };
+  char *sargv[] = { "find", "findd", "x", 0 };
+  char *np[] = { "5", "100" };
+  char *names[] = { "findd/x", "findd/a/b/x", "findd/a/x" };
+  char buf[64], obuf[64];
+  int fd, i, n, m;
+
+  if(mkdir("findd") < 0 || mkdir("findd/a") < 0 || mkdir("findd/a/b") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < sizeof(names)/sizeof(names[0]); i++){
+    if((fd = open(names[i], O_CREATE|O_WRONLY)) < 0){
+      printf("%s: create failed\n", s);
+      exit(1);
+    }
+    close(fd);
+  }
+
+  for(i = 0; i < sizeof(np)/sizeof(np[0]); i++){
+    argv[2] = np[i];
+    // "findd/x\n", "findd/a/b/x\n" and "findd/a/x\n", in any order.
+    if((n = findrun(s, argv, buf, sizeof(buf))) != 30){
+      printf("%s: find -P %s printed %d bytes\n", s, np[i], n);
+      exit(1);
+    }
+  }
+
+  n = findrun(s, sargv, buf, sizeof(buf));
+  m = findrun(s, oargv, obuf, sizeof(obuf));
+  if(n != 30 || m != n || memcmp(buf, obuf, n) != 0){
+    printf("%s: find -P 5 -o differs from find\n", s);
+    exit(1);
+  }
+
+  unlink("findd/a/b/x");
+  unlink("findd/a/x");
+  unlink("findd/a/b");
+  unlink("findd/a");
+  unlink("findd/x");
+  unlink("findd");
+}
+
+// clone() threads share memory, open files and the current
+// directory, and are waited for like children.
+#define NTHREAD 4
+int clonecount;
+int clonefd;
+char *cloneptr;
+int clonepipe[2];
+
+void
+cloneadd(void *arg)
+{
+  for(int i = 0; i < 1000; i++)
+    __sync_fetch_and_add(&clonecount, *(int*)arg);
+}
+
+void
+clonegrow(void *arg)
+{
+  char *p;
+
+  clonefd = open("clone-f", O_CREATE|O_WRONLY);
+  if((p = sbrk(4096)) != (char*)-1){
+    *p = 'x';
+    cloneptr = p;
+  }
+}
+
+void
+cloneblock(void *arg)
+{
+  char c;
+
+  read(clonepipe[0], &c, 1);
+}
+
+void
+clonetest(char *s)
+{
+  char *echoargv[] = { "echo", "OK", 0 };
+  char *stacks;
+  int i, one, xstatus;
+
+  if((stacks = malloc(NTHREAD*4096)) == 0){
+    printf("%s: malloc failed\n", s);
+    exit(1);
+  }
+
+  clonecount = 0;
+  one = 1;
+  for(i = 0; i < NTHREAD; i++){
+    if(clone(cloneadd, &one, stacks + (i+1)*4096) < 0){
+      printf("%s: clone failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < NTHREAD; i++){
+    if(wait(&xstatus) < 0 || xstatus != 0){
+      printf("%s: wait failed\n", s);
+      exit(1);
+    }
+  }
+  if(clonecount != NTHREAD*1000){
+    printf("%s: count %d, not %d\n", s, clonecount, NTHREAD*1000);
+    exit(1);
+  }
+
+  clonefd = -1;
+  cloneptr = 0;
+  if(clone(clonegrow, 0, stacks + 4096) < 0 || wait(0) < 0){
+    printf("%s: clone failed\n", s);
+    exit(1);
+  }
+  if(clonefd < 0 || write(clonefd, "x", 1) != 1){
+    printf("%s: thread's file not shared\n", s);
+    exit(1);
+  }
+  close(clonefd);
+  unlink("clone-f");
+  if(cloneptr == 0 || *cloneptr != 'x'){
+    printf("%s: thread's memory not shared\n", s);
+    exit(1);
+  }
+
+  // while another thread runs, memory cannot shrink and
+  // exec cannot replace it.
+  if(pipe(clonepipe) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(clone(cloneblock, 0, stacks + 4096) < 0){
+    printf("%s: clone failed\n", s);
+    exit(1);
+  }
+  if(sbrk(-4096) != (char*)-1){
+    printf("%s: sbrk shrank shared memory\n", s);
+    exit(1);
+  }
+  if(exec("echo", echoargv) >= 0){
+    printf("%s: exec with threads succeeded\n", s);
+    exit(1);
+  }
+  write(clonepipe[1], "x", 1);
+  if(wait(0) < 0){
+    printf("%s: wait failed\n", s);
+    exit(1);
+  }
+  close(clonepipe[0]);
+  close(clonepipe[1]);
+  if(sbrk(-4096) == (char*)-1){
+    printf("%s: sbrk failed after threads exited\n", s);
+    exit(1);
+  }
+  free(stacks);
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(char *s)
@@ -2364,6 +3536,112 @@ stacktest(char *s)
     exit(xstatus);
 }
 
+// system calls that copy to or from the stack guard page
+// fail rather than reaching it through the kernel's
+// mapping of user memory.
+void
+copyguard(char *s)
+{
+  char *guard = (char *) (PGROUNDDOWN(r_sp()) - PGSIZE);
+  char *args[] = { guard, 0 };
+  int fd, n, fds[2];
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  if((n = write(fds[1], guard + 100, 10)) > 0){
+    printf("%s: write from guard page returned %d\n", s, n);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  fd = open("README", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open README failed\n", s);
+    exit(1);
+  }
+  if((n = read(fd, guard + PGSIZE - 5, 10)) > 0){
+    printf("%s: read into guard page returned %d\n", s, n);
+    exit(1);
+  }
+  close(fd);
+
+  if(exec(guard, args) != -1 || open(guard, O_RDONLY) != -1){
+    printf("%s: path in guard page accepted\n", s);
+    exit(1);
+  }
+}
+
+// a large aligned sbrk() gets megapages; fork copies them,
+// and shrinking into the middle of one splits it.
+void
+superpage(char *s)
+{
+  char *a, *p;
+  uint64 top;
+  int pid, xstatus;
+
+  top = (uint64) sbrk(0);
+  if(sbrk(SUPERPGROUNDUP(top) - top) == (char*)-1){
+    printf("%s: sbrk align failed\n", s);
+    exit(1);
+  }
+  a = sbrk(2*SUPERPGSIZE);
+  if(a == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(p = a; p < a + 2*SUPERPGSIZE; p += PGSIZE){
+    if(*p != 0){
+      printf("%s: new memory not zero\n", s);
+      exit(1);
+    }
+    *(uint64*)p = (uint64)p;
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(p = a; p < a + 2*SUPERPGSIZE; p += PGSIZE)
+      if(*(uint64*)p != (uint64)p)
+        exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw wrong data\n", s);
+    exit(1);
+  }
+
+  // give back the last three 4KB pages of the second megapage.
+  if(sbrk(-3*PGSIZE) == (char*)-1){
+    printf("%s: sbrk shrink failed\n", s);
+    exit(1);
+  }
+  for(p = a; p < a + 2*SUPERPGSIZE - 3*PGSIZE; p += PGSIZE){
+    if(*(uint64*)p != (uint64)p){
+      printf("%s: lost data after shrink at %p\n", s, p);
+      exit(1);
+    }
+  }
+
+  pid = fork();
+  if(pid == 0){
+    *(a + 2*SUPERPGSIZE - PGSIZE) = 1;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: freed page still mapped\n", s);
+    exit(1);
+  }
+}
+
 // regression test. copyin(), copyout(), and copyinstr() used to cast
 // the virtual page address to uint, which (with certain wild system
 // call arguments) resulted in a kernel page faults.
@@ -2644,6 +3922,8 @@ main(int argc, char *argv[])
     {copyinstr1, "copyinstr1"},
     {copyinstr2, "copyinstr2"},
     {copyinstr3, "copyinstr3"},
+    {copyguard, "copyguard"},
+    {superpage, "superpage"},
     {truncate1, "truncate1"},
     {truncate2, "truncate2"},
     {truncate3, "truncate3"},
@@ -2685,6 +3965,24 @@ main(int argc, char *argv[])
     {iputtest, "iput"},
     {mem, "mem"},
     {pipe1, "pipe1"},
+    {pipe2, "pipe2"},
+    {splicetest, "splicetest"},
+    {splicepipetest, "splicepipetest"},
+    {polltest, "polltest"},
+    {uringtest, "uringtest"},
+    {vdsotest, "vdsotest"},
+    {proftest, "proftest"},
+    {sysstattest, "sysstattest"},
+    {tracetest, "tracetest"},
+    {perftest, "perftest"},
+    {stdiotest, "stdiotest"},
+    {malloctest, "malloctest"},
+    {getdentstest, "getdentstest"},
+    {vforktest, "vforktest"},
+    {spawntest, "spawntest"},
+    {shvforktest, "shvforktest"},
+    {findtest, "findtest"},
+    {clonetest, "clonetest"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
@@ -14,16 +14,26 @@ sub entry {
     print " ecall\n";
     print " ret\n";
 }
+
+# the stub for a system call that ulib.c wraps, named _name.
+sub rawentry {
+    my $name = shift;
+    print ".global _$name\n";
+    print "_${name}:\n";
+    print " li a7, SYS_${name}\n";
+    print " ecall\n";
+    print " ret\n";
+}
 	
-entry("fork");
-entry("exit");
+rawentry("fork");
+rawentry("exit");
 entry("wait");
 entry("pipe");
 entry("read");
 entry("write");
-entry("close");
+rawentry("close");
 entry("kill");
-entry("exec");
+rawentry("exec");
 entry("open");
 entry("mknod");
 entry("unlink");
@@ -36,3 +46,20 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("splice");
+entry("tee");
+entry("sendfile");
+entry("poll");
+entry("fcntl");
+entry("uring_enter");
+entry("profctl");
+entry("profread");
+entry("sysstat");
+entry("tracectl");
+entry("traceread");
+entry("perfstat");
+entry("getdents");
+entry("fstatat");
+entry("vfork");
+entry("spawn");
+rawentry("clone");
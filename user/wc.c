@@ -1,27 +1,91 @@
+// Count lines, words and bytes.
+//
+// Input is read BUFSZ bytes at a time and scanned a 64-bit
+// word at a time: the newline and whitespace bytes in a word
+// are found with a few arithmetic operations, SWAR style,
+// and counted with a multiply. The few bytes at the end of a
+// read are looked up in a class table. Only the counts asked
+// for are computed; -c alone does no scanning at all.
+//
+// usage: wc [-l] [-w] [-c] [file ...]
+
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
 
-char buf[512];
+#define BUFSZ (64*1024)
+
+#define ONES  0x0101010101010101L
+#define HIGHS 0x8080808080808080L
+#define LOWS  0x7f7f7f7f7f7f7f7fL
+
+#define CSPACE 1
+#define CNL    2
+
+uint64 buf[BUFSZ/8];
+uchar class[256];
+int lflag, wflag, cflag;
+
+// the high bit of each byte of w that equals c.
+static inline uint64
+eqbytes(uint64 w, uint64 c)
+{
+  uint64 x = w ^ (c * ONES);
+  return ~(((x & LOWS) + LOWS) | x) & HIGHS;
+}
+
+// the number of high bits set in m, which has no others.
+static inline int
+count(uint64 m)
+{
+  return ((m >> 7) * ONES) >> 56;
+}
+
+static inline uint64
+spaces(uint64 w)
+{
+  return eqbytes(w, ' ') | eqbytes(w, '\t') | eqbytes(w, '\n') |
+         eqbytes(w, '\v') | eqbytes(w, '\r');
+}
 
 void
 wc(int fd, char *name)
 {
-  int i, n;
-  int l, w, c, inword;
+  int i, n, nw;
+  int l, w, c;
+  uint64 x, sp, prevsp;
+  uchar *p;
 
   l = w = c = 0;
-  inword = 0;
+  prevsp = 0x80;   // the byte before the first counts as space
   while((n = read(fd, buf, sizeof(buf))) > 0){
-    for(i=0; i<n; i++){
-      c++;
-      if(buf[i] == '\n')
+    c += n;
+    nw = n / 8;
+    if(lflag && !wflag){
+      for(i = 0; i < nw; i++)
+        l += count(eqbytes(buf[i], '\n'));
+    } else if(wflag){
+      for(i = 0; i < nw; i++){
+        x = buf[i];
+        sp = spaces(x);
+        // a word starts at a non-space byte after a space.
+        w += count(~sp & ((sp << 8) | prevsp) & HIGHS);
+        prevsp = sp >> 56;
+        if(lflag)
+          l += count(eqbytes(x, '\n'));
+      }
+    }
+    if(!lflag && !wflag)
+      continue;
+    p = (uchar*)buf;
+    for(i = nw * 8; i < n; i++){
+      if(class[p[i]] & CNL)
         l++;
-      if(strchr(" \r\t\n\v", buf[i]))
-        inword = 0;
-      else if(!inword){
-        w++;
-        inword = 1;
+      if(class[p[i]] & CSPACE){
+        prevsp = 0x80;
+      } else {
+        w += prevsp != 0;
+        prevsp = 0;
       }
     }
   }
@@ -29,20 +93,48 @@ wc(int fd, char *name)
     printf("wc: read error\n");
     exit(1);
   }
-  printf("%d %d %d %s\n", l, w, c, name);
+  if(lflag)
+    printf("%d ", l);
+  if(wflag)
+    printf("%d ", w);
+  if(cflag)
+    printf("%d ", c);
+  printf("%s\n", name);
 }
 
 int
 main(int argc, char *argv[])
 {
   int fd, i;
+  char *s;
+
+  for(s = " \r\t\n\v"; *s; s++)
+    class[(uchar)*s] |= CSPACE;
+  class['\n'] |= CNL;
+
+  for(i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++){
+    for(s = argv[i] + 1; *s; s++){
+      if(*s == 'l')
+        lflag = 1;
+      else if(*s == 'w')
+        wflag = 1;
+      else if(*s == 'c')
+        cflag = 1;
+      else {
+        fprintf(2, "usage: wc [-l] [-w] [-c] [file ...]\n");
+        exit(1);
+      }
+    }
+  }
+  if(!lflag && !wflag && !cflag)
+    lflag = wflag = cflag = 1;
 
-  if(argc <= 1){
+  if(i >= argc){
     wc(0, "");
     exit(0);
   }
 
-  for(i = 1; i < argc; i++){
+  for(; i < argc; i++){
     if((fd = open(argv[i], 0)) < 0){
       printf("wc: cannot open %s\n", argv[i]);
       exit(1);
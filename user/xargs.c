@@ -3,83 +3,136 @@
 #include "kernel/param.h"
 #include "user/user.h"
 
-void copy(char **p1, char *p2){
-    *p1 = malloc(strlen(p2) + 1);
-    strcpy(*p1, p2);
-}
+// usage: xargs [-n N] [-P N] command [args...]
+//
+// Runs command once per input line, with the line's words
+// appended. -n N runs it with up to N words per exec, however
+// they are split into lines. -P N keeps up to N commands
+// running at once.
 
-// i为起始下标
-int readLine(char **pars, int i){
-    int d = 1024;
-    char buf[d];
-    int j = 0;
-    // 读取1行
-    while (read(0, buf + j, 1)){
-        // 按行划分
-        if (buf[j] == '\n'){
-            buf[j] = 0;
-            break;
-        }
-        j++;
-        if (j == d){
-            fprintf(2, "Parameters are too long!\n");
-            exit(1);
+#define WORDSZ 512
+#define ARGSZ  4096
+
+char inbuf[4096];
+int inn, inpos;
+
+char argbuf[ARGSZ];
+
+// next byte of stdin, or -1 at end of input.
+int getch(void){
+    if (inpos == inn){
+        inpos = 0;
+        if ((inn = read(0, inbuf, sizeof(inbuf))) <= 0){
+            inn = 0;
+            return -1;
         }
     }
-    
-    // 没有读取内容
-    if (j == 0){
-        return -1;
-    }
+    return inbuf[inpos++] & 0xff;
+}
+
+// read a word into w. sets *eol if the word, or an empty
+// rest of the line, ends the line. returns the word's length,
+// or -1 at end of input.
+int readWord(char *w, int *eol){
+    int c, n;
 
-    // 按照空格划分
-    int k = 0;
-    while (k < j){
-        if (i > MAXARG){
-            fprintf(2, "Too much parameters!\n");
+    *eol = 0;
+    while ((c = getch()) == ' ' || c == '\t')
+        ;
+    if (c < 0)
+        return -1;
+    n = 0;
+    while (c >= 0 && c != ' ' && c != '\t' && c != '\n'){
+        if (n == WORDSZ - 1){
+            fprintf(2, "xargs: argument too long\n");
             exit(1);
         }
-        // '   abc   sdf'
-        // 忽略
-        while ((k < j) && (buf[k] == ' ')){
-            k++;
-        }
-        // 起始位置
-        int l = k;
-        // 保留字符
-        while ((k < j) && (buf[k] != ' ')){
-            k++;
-        }
-        // 注意需要k++
-        buf[k++] = 0;
-        copy(&pars[i], buf + l);
-        i++;
+        w[n++] = c;
+        c = getch();
     }
-
-    return i;
+    w[n] = 0;
+    if (c == '\n' || c < 0)
+        *eol = 1;
+    return n;
 }
 
 int main(int argc, char *argv[]){
-    if (argc < 2){
-        printf("Please enter more parameters!\n");
+    char *pars[MAXARG], *p;
+    int i, base, maxargs, nargs, nflag, par, running, n, eol, done;
+
+    nflag = 0;
+    par = 1;
+    for (i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2){
+        if (strcmp(argv[i], "-n") == 0 && (nflag = atoi(argv[i + 1])) > 0)
+            continue;
+        if (strcmp(argv[i], "-P") == 0 && (par = atoi(argv[i + 1])) > 0)
+            continue;
+        break;
+    }
+    if (i >= argc || argv[i][0] == '-'){
+        fprintf(2, "usage: xargs [-n N] [-P N] command [args...]\n");
         exit(1);
-    }else{
-        int i;
-        char *pars[MAXARG];
-        for (i = 1; i < argc; i++){
-            copy(&pars[i - 1], argv[i]);
+    }
+
+    base = 0;
+    for (; i < argc; i++){
+        if (base == MAXARG - 2){
+            fprintf(2, "xargs: too many arguments\n");
+            exit(1);
         }
-        
-        int end;
-        while ((end = readLine(pars, argc - 1)) != -1){
-            pars[end] = 0;
-            if (fork() == 0){
-                exec(pars[0], pars);
+        pars[base++] = argv[i];
+    }
+    // exec takes MAXARG - 1 arguments and the terminating 0.
+    maxargs = MAXARG - 1 - base;
+    if (nflag && nflag < maxargs)
+        maxargs = nflag;
+
+    running = 0;
+    done = 0;
+    while (!done){
+        nargs = 0;
+        p = argbuf;
+        for (;;){
+            if (nflag && (nargs == maxargs || argbuf + ARGSZ - p < WORDSZ))
+                break;
+            // without -n a line must fit in one exec.
+            if (argbuf + ARGSZ - p < WORDSZ){
+                fprintf(2, "xargs: line too long\n");
                 exit(1);
-            }else{
-                wait(0);
             }
+            if ((n = readWord(p, &eol)) < 0){
+                done = 1;
+                break;
+            }
+            if (n > 0){
+                if (nargs == maxargs){
+                    fprintf(2, "xargs: too many arguments\n");
+                    exit(1);
+                }
+                pars[base + nargs++] = p;
+                p += n + 1;
+            }
+            if (eol && !nflag && nargs > 0)
+                break;
+        }
+        if (nargs == 0)
+            continue;
+        pars[base + nargs] = 0;
+
+        // keep at most par children; reap one to make room.
+        if (running == par){
+            wait(0);
+            running--;
+        }
+        // spawn() builds the child from the file, copying
+        // nothing of this process.
+        if (spawn(pars[0], pars, 0, 0) < 0){
+            fprintf(2, "xargs: exec %s failed\n", pars[0]);
+            continue;
         }
-        exit(0);
+        running++;
     }
+    while (running-- > 0)
+        wait(0);
+    exit(0);
 }